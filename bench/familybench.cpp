@@ -0,0 +1,376 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include <QFileInfo>
+#include <QGraphicsSceneMouseEvent>
+#include <QImage>
+#include <QLoggingCategory>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <memory>
+
+#include "family.h"
+#include "familyautosave.h"
+#include "familydiff.h"
+#include "familygenerator.h"
+#include "familymemberitem.h"
+#include "familytreescene.h"
+#include "memoryreport.h"
+
+// Run with e.g. "-o result.xml,xml" or "-o result.csv,csv" for machine-readable output, and "-platform offscreen"
+// on machines without a display. FAMILY_TREE_BENCH_SIZES="1000,100000,1000000" overrides the tree sizes.
+
+class FamilyBench : public QObject {
+  Q_OBJECT
+
+ private slots:
+  void initTestCase();
+
+  void fromJson_data() { addSizes(); }
+  void fromJson();
+  void toJson_data() { addSizes(); }
+  void toJson();
+  void relayout_data() { addSizes(); }
+  void relayout();
+  void searchIndexBuild_data() { addSizes(); }
+  void searchIndexBuild();
+  void searchIndexMemory_data() { addSizes(); }
+  void searchIndexMemory();
+  void sceneMemory_data() { addSizes(); }
+  void sceneMemory();
+  void topologyTraversal_data() { addSizes(); }
+  void topologyTraversal();
+  void sceneBuild_data() { addSizes(); }
+  void sceneBuild();
+  void sceneRelayout_data() { addSizes(); }
+  void sceneRelayout();
+  void itemConstruction_data() { addSizes(); }
+  void itemConstruction();
+  void dragMove_data() { addSizes(); }
+  void dragMove();
+  void exportImage_data() { addSizes(); }
+  void exportImage();
+  void merge_data() { addSizes(); }
+  void merge();
+  void snapshotAfterEdit_data() { addSizes(); }
+  void snapshotAfterEdit();
+  void load_data() { addSizes(); }
+  void load();
+  void loadCompressed_data() { addSizes(); }
+  void loadCompressed();
+
+  // Checks rather than measures.
+  void autosaveAfterSave();
+
+ private:
+  void addSizes();
+  void benchLoad(const QString& fileName);
+  Family* family(int size);
+
+ private:
+  std::map<int, QByteArray> m_sizeToJson;
+  std::map<int, std::unique_ptr<Family>> m_sizeToFamily;
+};
+
+void FamilyBench::initTestCase() { QLoggingCategory::setFilterRules("default.debug=false"); }
+
+void FamilyBench::addSizes() {
+  QTest::addColumn<int>("size");
+  QByteArray sizes = qgetenv("FAMILY_TREE_BENCH_SIZES");
+  if (sizes.isEmpty()) {
+    sizes = "1000,10000,40000";
+  }
+  for (const QByteArray& size : sizes.split(',')) {
+    QTest::newRow(size.constData()) << size.toInt();
+  }
+}
+
+Family* FamilyBench::family(int size) {
+  std::unique_ptr<Family>& result = m_sizeToFamily[size];
+  if (!result) {
+    if (!m_sizeToJson.count(size)) {
+      FamilyGeneratorOptions options;
+      options.memberCount = size;
+      options.noteLength = 40;
+      m_sizeToJson[size] = FamilyGenerator::generate(options);
+    }
+    result.reset(Family::fromJson(m_sizeToJson[size]));
+    result->relayout();
+  }
+  return result.get();
+}
+
+void FamilyBench::fromJson() {
+  QFETCH(int, size);
+  family(size);
+  const QByteArray& json = m_sizeToJson[size];
+  QBENCHMARK {
+    delete Family::fromJson(json);
+  }
+}
+
+void FamilyBench::toJson() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  QBENCHMARK {
+    f->toJson();
+  }
+}
+
+void FamilyBench::relayout() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  QBENCHMARK {
+    f->relayout();
+  }
+}
+
+void FamilyBench::searchIndexBuild() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  std::vector<FamilyMember> members;
+  for (int i = 0; i < f->topology().size(); i++) {
+    members.push_back(f->getMember(f->topology().idAt(i)));
+  }
+  QBENCHMARK {
+    FamilySearchIndex index;
+    for (const FamilyMember& member : members) {
+      index.update(member);
+    }
+  }
+}
+
+void FamilyBench::searchIndexMemory() {
+  QFETCH(int, size);
+  QTest::setBenchmarkResult(family(size)->searchIndex().memoryUsage(), QTest::BytesAllocated);
+}
+
+void FamilyBench::sceneMemory() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  FamilyTreeScene scene(nullptr);
+  scene.setFamily(f);
+  scene.flushRebuild();
+  MemoryReport report = MemoryReport::collect(f, &scene);
+  for (const MemoryReport::Entry& entry : report.entries) {
+    qInfo().noquote() << entry.name << entry.count << entry.bytes;
+  }
+  QTest::setBenchmarkResult(report.totalBytes(), QTest::BytesAllocated);
+  scene.setFamily(nullptr);
+}
+
+void FamilyBench::topologyTraversal() {
+  QFETCH(int, size);
+  const FamilyTopology& topology = family(size)->topology();
+  QBENCHMARK {
+    qint64 sum = 0;
+    for (int i = 0; i < topology.size(); i++) {
+      for (int child = topology.childBegin(i); child < topology.childEnd(i); child++) {
+        sum += topology.layer(child);
+      }
+    }
+    QVERIFY(sum > 0);
+  }
+}
+
+void FamilyBench::sceneBuild() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  QBENCHMARK {
+    FamilyTreeScene scene(nullptr);
+    scene.setFamily(f);
+    scene.flushRebuild();
+    scene.setFamily(nullptr);
+  }
+}
+
+void FamilyBench::sceneRelayout() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  FamilyTreeScene scene(nullptr);
+  scene.setFamily(f);
+  scene.flushRebuild();
+  QBENCHMARK {
+    f->relayout();
+    scene.flushRebuild();
+  }
+  scene.setFamily(nullptr);
+}
+
+void FamilyBench::itemConstruction() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  FamilyTreeScene scene(nullptr);
+  std::vector<FamilyMember> members;
+  for (int i = 0; i < f->topology().size(); i++) {
+    members.push_back(f->getMember(f->topology().idAt(i)));
+  }
+  QBENCHMARK {
+    for (const FamilyMember& member : members) {
+      delete new FamilyMemberItem(&scene, member);
+    }
+  }
+}
+
+void FamilyBench::dragMove() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  FamilyTreeScene scene(nullptr);
+  scene.setFamily(f);
+  scene.flushRebuild();
+
+  // The widest sibling row below the root.
+  const FamilyTopology& topology = f->topology();
+  int parent = 0;
+  for (int i = 0; i < topology.size(); i++) {
+    if (topology.childEnd(i) - topology.childBegin(i) > topology.childEnd(parent) - topology.childBegin(parent)) {
+      parent = i;
+    }
+  }
+  QVERIFY(topology.childEnd(parent) - topology.childBegin(parent) > 1);
+  FamilyMemberItem* item = scene.getItem(topology.idAt(topology.childBegin(parent)));
+  FamilyMemberItem* last = scene.getItem(topology.idAt(topology.childEnd(parent) - 1));
+
+  QGraphicsSceneMouseEvent press(QEvent::GraphicsSceneMousePress);
+  press.setPos(QPointF(10, 10));
+  press.setScenePos(item->scenePos() + QPointF(10, 10));
+  scene.onItemDragBegin(item, &press);
+  QGraphicsSceneMouseEvent move(QEvent::GraphicsSceneMouseMove);
+  QBENCHMARK {
+    for (qreal x = item->x(); x < last->x() + last->width(); x += 7) {
+      move.setScenePos(QPointF(x, item->y()));
+      scene.onItemDragMoving(item, &move);
+    }
+  }
+  scene.setFamily(nullptr);
+}
+
+void FamilyBench::exportImage() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  FamilyTreeScene scene(nullptr);
+  scene.setFamily(f);
+  QTemporaryDir dir;
+  QString path = dir.filePath("export.png");
+  // The same steps as File > Export: finish the scene, render the whole tree and write the png.
+  QBENCHMARK {
+    scene.flushRebuild();
+    QImage image = scene.renderImage(scene.sceneRect());
+    if (image.isNull()) {
+      scene.setFamily(nullptr);
+      QSKIP("the whole tree is larger than a QImage can hold");
+    }
+    QVERIFY(image.save(path));
+  }
+  scene.setFamily(nullptr);
+}
+
+void FamilyBench::merge() {
+  QFETCH(int, size);
+  family(size);
+  const QByteArray& json = m_sizeToJson[size];
+  std::unique_ptr<Family> base(Family::fromJson(json));
+  std::unique_ptr<Family> ours(Family::fromJson(json));
+  std::unique_ptr<Family> theirs(Family::fromJson(json));
+  // Every 10th member renamed in ours, every 7th member's spouse renamed in theirs, both overlap every 70th.
+  const FamilyTopology& topology = base->topology();
+  for (int i = 0; i < topology.size(); i++) {
+    FamilyMember member = base->getMember(topology.idAt(i));
+    if (i % 10 == 0) {
+      member.name += "'";
+      ours->updateMember(member);
+    }
+    if (i % 7 == 0) {
+      member.spouseName += "'";
+      theirs->updateMember(member);
+    }
+  }
+  QBENCHMARK {
+    FamilyDiff::Merge merge = FamilyDiff::merge(*base, *ours, *theirs);
+    QVERIFY(merge.conflicts.empty());
+  }
+}
+
+void FamilyBench::snapshotAfterEdit() {
+  QFETCH(int, size);
+  Family* f = family(size);
+  std::shared_ptr<const FamilySnapshot> previous = f->snapshot();
+  const FamilyTopology& topology = f->topology();
+  int i = 0;
+  QBENCHMARK {
+    FamilyMember member = f->getMember(topology.idAt(i++ % topology.size()));
+    member.isAlive = !member.isAlive;
+    f->updateMember(member);
+    previous = f->snapshot();
+  }
+  QVERIFY(previous->size() == f->size());
+}
+
+void FamilyBench::load() { benchLoad("family.json"); }
+
+void FamilyBench::loadCompressed() { benchLoad("family.jsonz"); }
+
+void FamilyBench::benchLoad(const QString& fileName) {
+  QFETCH(int, size);
+  QTemporaryDir dir;
+  QString path = dir.filePath(fileName);
+  Family* saved = family(size);
+  QVERIFY(saved->save(path));
+  qInfo() << fileName << QFileInfo(path).size() / 1024 << "KB";
+  QBENCHMARK {
+    std::unique_ptr<Family> f(Family::load(path));
+    QVERIFY(f && f->size() == saved->size());
+  }
+}
+
+// A journal written before a save must not be replayed onto the saved file.
+void FamilyBench::autosaveAfterSave() {
+  QStandardPaths::setTestModeEnabled(true);
+  QTemporaryDir dir;
+  QString path = dir.filePath("family.json");
+  Family f;
+  QVERIFY(f.save(path));
+  FamilyAutosave autosave;
+  autosave.setFamily(&f, path);
+
+  FamilyMember member = f.getMember(f.rootId());
+  member.name += "'";
+  f.updateMember(member);
+  autosave.checkpoint();
+  autosave.waitForWrite();
+  QString sourcePath;
+  std::unique_ptr<Family> restored(autosave.restore(&sourcePath));
+  QVERIFY(restored && restored->getMember(f.rootId()).name == member.name);
+
+  QVERIFY(f.save(path));
+  f.setIsDirty(false);
+  autosave.setFamily(&f, path);
+  restored.reset(autosave.restore(&sourcePath));
+  QVERIFY(!restored);
+  autosave.discard();
+}
+
+QTEST_MAIN(FamilyBench)
+#include "familybench.moc"
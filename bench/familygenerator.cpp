@@ -0,0 +1,174 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familygenerator.h"
+
+#include <QBuffer>
+#include <QJsonDocument>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <random>
+
+#include "familymember.h"
+
+static const QUuid kGeneratorNamespace("{6f1e3c52-8a4d-4b7e-a0c9-3d5b2e7f1a68}");
+
+static const char32_t kCjkSurnames[] = U"张王李赵陈刘杨黄周吴徐孙胡朱高林何郭马罗";
+static const char32_t kCjkGivenChars[] = U"伟芳娜敏静强磊军洋勇艳杰涛明超秀霞平刚桂英华玉兰文建国志红德";
+static const char32_t kCjkNoteChars[] = U"生于民国年间迁居江南务农经商读书育有子女享年岁葬祖茔";
+static const char* kLatinSurnames[] = {"Zhang", "Wang", "Li", "Zhao", "Chen", "Liu", "Yang", "Huang", "Smith", "Brown"};
+static const char* kLatinSyllables[] = {"wei", "fang", "min", "jing", "qiang", "lei", "jun", "yang", "yong",
+                                        "jie", "tao", "ming", "chao", "xiu", "ping", "gang", "hua", "yu"};
+static const char* kLatinNoteWords[] = {"born", "in", "the", "village", "moved", "to", "city", "farmer",
+                                        "merchant", "teacher", "married", "had", "three", "children", "died"};
+
+class MemberGenerator {
+ public:
+  explicit MemberGenerator(const FamilyGeneratorOptions& options) : m_options(options), m_random(options.seed) {}
+
+  MemberId idAt(qint64 index) const {
+    return QUuid::createUuidV5(kGeneratorNamespace,
+                               QByteArray::number(m_options.seed) + ':' + QByteArray::number(index));
+  }
+
+  int childCount() {
+    switch (m_options.branching) {
+      case FamilyGeneratorOptions::Branching::Uniform:
+        return std::uniform_int_distribution<int>(0, std::lround(m_options.meanChildren * 2))(m_random);
+      case FamilyGeneratorOptions::Branching::Geometric:
+        return std::geometric_distribution<int>(1 / (1 + m_options.meanChildren))(m_random);
+      case FamilyGeneratorOptions::Branching::Poisson:
+      default:
+        return std::poisson_distribution<int>(m_options.meanChildren)(m_random);
+    }
+  }
+
+  void fill(FamilyMember& member) {
+    member.title = m_options.latin ? QString("Gen %1").arg(pick(30) + 1) : QString("%1世").arg(pick(30) + 1);
+    member.name = name();
+    member.isMale = pick(2);
+    member.isAlive = pick(4) == 0;
+    member.isSpouseAlive = member.isAlive && pick(2);
+    member.spouseName = pick(2) ? name() : "";
+    bool hasNote = m_options.noteLength > 0 && std::bernoulli_distribution(m_options.noteRatio)(m_random);
+    member.note = hasNote ? note() : "";
+  }
+
+ private:
+  int pick(int count) { return std::uniform_int_distribution<int>(0, count - 1)(m_random); }
+
+  QString name() {
+    if (m_options.latin) {
+      QString given;
+      for (int i = 0; i < m_options.nameLength; i++) {
+        given += kLatinSyllables[pick(std::size(kLatinSyllables))];
+      }
+      given[0] = given[0].toUpper();
+      return given + " " + kLatinSurnames[pick(std::size(kLatinSurnames))];
+    }
+    std::u32string result(1, kCjkSurnames[pick(std::size(kCjkSurnames) - 1)]);
+    for (int i = 0; i < m_options.nameLength; i++) {
+      result += kCjkGivenChars[pick(std::size(kCjkGivenChars) - 1)];
+    }
+    return QString::fromStdU32String(result);
+  }
+
+  QString note() {
+    if (m_options.latin) {
+      QString result;
+      while (result.size() < m_options.noteLength) {
+        result += kLatinNoteWords[pick(std::size(kLatinNoteWords))];
+        result += " ";
+      }
+      return result.left(m_options.noteLength).trimmed();
+    }
+    std::u32string result;
+    for (int i = 0; i < m_options.noteLength; i++) {
+      result += kCjkNoteChars[pick(std::size(kCjkNoteChars) - 1)];
+    }
+    return QString::fromStdU32String(result);
+  }
+
+ private:
+  const FamilyGeneratorOptions& m_options;
+  std::mt19937 m_random;
+};
+
+qint64 FamilyGenerator::write(const FamilyGeneratorOptions& options, QIODevice* out) {
+  Q_ASSERT(out && out->isWritable());
+  MemberGenerator generator(options);
+  // Breadth-first, so the children of a member are the next unassigned indexes and only the parent links need
+  // to be remembered.
+  std::vector<qint64> parents({-1});
+  std::vector<int> indexesAsChild({0});
+  std::vector<int> depths({1});
+
+  out->write("{\n\"version\": 2,\n\"title\": \"");
+  out->write(options.latin ? "Generated" : "生成家谱");
+  out->write("\",\n\"rootId\": \"");
+  out->write(memberIdToString(generator.idAt(0)).toUtf8());
+  out->write("\",\n\"members\": [\n");
+  qint64 index = 0;
+  for (; index < static_cast<qint64>(parents.size()); index++) {
+    FamilyMember member;
+    member.id = generator.idAt(index);
+    generator.fill(member);
+    if (parents[index] != -1) {
+      member.parentId = generator.idAt(parents[index]);
+      member.indexAsChild = indexesAsChild[index];
+    }
+
+    qint64 remaining = options.memberCount - static_cast<qint64>(parents.size());
+    int childCount = 0;
+    if (remaining > 0 && (options.maxDepth == 0 || depths[index] < options.maxDepth)) {
+      childCount = generator.childCount();
+      // Keep the tree growing until it is big enough.
+      if (index + 1 == static_cast<qint64>(parents.size())) {
+        childCount = std::max(childCount, 1);
+      }
+      childCount = std::min<qint64>(childCount, remaining);
+    }
+    for (int i = 0; i < childCount; i++) {
+      member.children.push_back(generator.idAt(parents.size()));
+      parents.push_back(index);
+      indexesAsChild.push_back(i);
+      depths.push_back(depths[index] + 1);
+    }
+
+    if (index > 0) {
+      out->write(",\n");
+    }
+    out->write(QJsonDocument(member.toJson()).toJson(QJsonDocument::Compact));
+  }
+  out->write("\n]\n}\n");
+  return index;
+}
+
+QByteArray FamilyGenerator::generate(const FamilyGeneratorOptions& options) {
+  QBuffer buffer;
+  buffer.open(QBuffer::WriteOnly);
+  write(options, &buffer);
+  return buffer.data();
+}
@@ -0,0 +1,53 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QIODevice>
+
+// Deterministic synthetic families for load and scaling tests. The same options always produce the same file.
+// Members are generated breadth-first and streamed out one by one, only about 16 bytes per member are kept.
+struct FamilyGeneratorOptions {
+  enum class Branching { Uniform, Poisson, Geometric };
+
+  quint32 seed = 1;
+  qint64 memberCount = 1000;
+  // 0 for no limit, the root is at depth 1.
+  int maxDepth = 0;
+  Branching branching = Branching::Poisson;
+  double meanChildren = 2.0;
+  // Given name length, in characters for CJK and in syllables for latin text.
+  int nameLength = 2;
+  int noteLength = 0;
+  double noteRatio = 0.2;
+  bool latin = false;
+};
+
+class FamilyGenerator {
+ public:
+  // Returns the number of members written, less than memberCount when maxDepth doesn't leave room for more.
+  static qint64 write(const FamilyGeneratorOptions& options, QIODevice* out);
+  static QByteArray generate(const FamilyGeneratorOptions& options);
+};
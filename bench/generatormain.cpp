@@ -0,0 +1,89 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+
+#include "familygenerator.h"
+
+int main(int argc, char* argv[]) {
+  QCoreApplication a(argc, argv);
+  QCoreApplication::setApplicationName("family_tree_gen");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Writes a deterministic synthetic family file.");
+  parser.addHelpOption();
+  QCommandLineOption outputOption({"o", "output"}, "Output file, stdout if omitted.", "path");
+  QCommandLineOption seedOption({"s", "seed"}, "Random seed.", "seed", "1");
+  QCommandLineOption membersOption({"n", "members"}, "Number of members.", "count", "1000");
+  QCommandLineOption depthOption("max-depth", "Maximum number of generations, 0 for no limit.", "depth", "0");
+  QCommandLineOption branchingOption("branching", "Children per member: uniform, poisson or geometric.", "kind",
+                                     "poisson");
+  QCommandLineOption meanOption("mean-children", "Mean number of children.", "mean", "2");
+  QCommandLineOption nameLengthOption("name-length", "Given name length.", "length", "2");
+  QCommandLineOption noteLengthOption("note-length", "Note length in characters, 0 for no notes.", "length", "0");
+  QCommandLineOption noteRatioOption("note-ratio", "Share of members with a note.", "ratio", "0.2");
+  QCommandLineOption latinOption("latin", "Latin names and notes instead of CJK.");
+  parser.addOptions({outputOption, seedOption, membersOption, depthOption, branchingOption, meanOption,
+                     nameLengthOption, noteLengthOption, noteRatioOption, latinOption});
+  parser.process(a);
+
+  FamilyGeneratorOptions options;
+  options.seed = parser.value(seedOption).toUInt();
+  options.memberCount = std::max(1LL, parser.value(membersOption).toLongLong());
+  options.maxDepth = parser.value(depthOption).toInt();
+  options.meanChildren = parser.value(meanOption).toDouble();
+  options.nameLength = parser.value(nameLengthOption).toInt();
+  if (options.nameLength < 1) {
+    qCritical() << "name length must be at least 1:" << parser.value(nameLengthOption);
+    return 1;
+  }
+  options.noteLength = parser.value(noteLengthOption).toInt();
+  options.noteRatio = parser.value(noteRatioOption).toDouble();
+  options.latin = parser.isSet(latinOption);
+  QString branching = parser.value(branchingOption);
+  if (branching == "uniform") {
+    options.branching = FamilyGeneratorOptions::Branching::Uniform;
+  } else if (branching == "geometric") {
+    options.branching = FamilyGeneratorOptions::Branching::Geometric;
+  } else if (branching != "poisson") {
+    qCritical() << "unknown branching:" << branching;
+    return 1;
+  }
+
+  QFile file;
+  bool ret = parser.isSet(outputOption) ? (file.setFileName(parser.value(outputOption)), file.open(QFile::WriteOnly))
+                                        : file.open(stdout, QFile::WriteOnly);
+  if (!ret) {
+    qCritical() << "can't open output:" << file.errorString();
+    return 1;
+  }
+  qint64 count = FamilyGenerator::write(options, &file);
+  if (count < options.memberCount) {
+    qWarning() << "max depth reached, wrote" << count << "of" << options.memberCount << "members";
+  }
+  return 0;
+}
@@ -25,6 +25,7 @@
 #include "arrowitem.h"
 
 #include "familymemberitem.h"
+#include "memoryreport.h"
 
 ArrowItem::ArrowItem(FamilyMemberItem* startItem, FamilyMemberItem* endItem, QGraphicsItem* parent)
     : QGraphicsPathItem(parent), m_startItem(startItem), m_endItem(endItem) {
@@ -57,4 +58,9 @@ void ArrowItem::updatePosition() {
   setPath(path);
 }
 
+qint64 ArrowItem::memoryUsage() const {
+  return sizeof(*this) + MemoryReport::kGraphicsItemPrivateSize +
+         path().elementCount() * sizeof(QPainterPath::Element);
+}
+
 void ArrowItem::mousePressEvent(QGraphicsSceneMouseEvent* event) { QGraphicsPathItem::mousePressEvent(event); }
@@ -32,6 +32,8 @@ class ArrowItem : public QGraphicsPathItem {
   explicit ArrowItem(FamilyMemberItem* startItem, FamilyMemberItem* endItem, QGraphicsItem* parent = nullptr);
 
   void updatePosition();
+  FamilyMemberItem* startItem() const { return m_startItem; }
+  qint64 memoryUsage() const;
 
  protected:
   void mousePressEvent(QGraphicsSceneMouseEvent* event) override;
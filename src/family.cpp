@@ -24,48 +24,407 @@
 
 #include "family.h"
 
+#include <QElapsedTimer>
+#include <QFile>
 #include <QJsonArray>
 #include <QJsonDocument>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
 #include <unordered_set>
 
+#include "familydiff.h"
+#include "memoryreport.h"
+#include "perfstats.h"
+#include "trace.h"
+
 static const char* kDefaultFamilyTitle = "Untitled";
+// Version 2 added the string table, members refer to its entries by index. Builds that only know version 1 read those
+// indexes as empty strings, so older files open here but files saved here don't open correctly there. A file newer
+// than this build is refused for the same reason.
+static const int kFileVersion = 2;
+// Notes longer than this are saved out of line after the json, separated by a form feed which json never contains
+// unescaped.
+static const int kNotePreviewLength = 64;
+static const char kNotesSeparator = '\f';
+static const qint64 kReadChunkSize = 1 << 20;
+// "*.jsonz" files hold the json as zlib blocks, each after its big-endian size, and an empty block ends them. Out of
+// line notes follow uncompressed so they can still be read on demand.
+static const char* kCompressedSuffix = ".jsonz";
+static const QByteArray kCompressedMagic("FTZ1");
+// qCompress of one kReadChunkSize chunk: its 4 byte length prefix plus zlib's worst case for incompressible data.
+static const qint64 kMaxCompressedBlockSize =
+    4 + kReadChunkSize + (kReadChunkSize >> 12) + (kReadChunkSize >> 14) + 13;
+static const quint64 kHashSeed = 0xcbf29ce484222325ULL;
+
+// FNV-1a, unlike qHash it is the same across runs and Qt versions.
+static quint64 hashBytes(quint64 hash, const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static quint64 hashString(quint64 hash, const QString& s) {
+  int size = s.size();
+  hash = hashBytes(hash, &size, sizeof(size));
+  return hashBytes(hash, s.constData(), size * sizeof(QChar));
+}
+
+static quint64 combineHash(quint64 hash, quint64 value) {
+  return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+}
+
+// Kept in FamilyMember::noteHash while the body is out of line, so moving a note out of line leaves the hash as is.
+static quint64 noteHash(const QString& body) { return hashString(kHashSeed, body); }
+
+// The member's own fields, every byte a save writes for it.
+static quint64 memberHash(const FamilyMember& member) {
+  quint64 hash = hashBytes(kHashSeed, &member.id, sizeof(member.id));
+  for (const QString* field : {&member.title, &member.name, &member.spouseName, &member.portrait}) {
+    hash = hashString(hash, *field);
+  }
+  unsigned char flags = (member.isMale ? 1 : 0) | (member.isAlive ? 2 : 0) | (member.isSpouseAlive ? 4 : 0);
+  hash = hashBytes(hash, &flags, sizeof(flags));
+  quint64 note = member.noteOffset == -1 ? noteHash(member.note) : member.noteHash;
+  return hashBytes(hash, &note, sizeof(note));
+}
+
+// Ids without braces and dashes, 32 characters instead of 38.
+static QString compactId(const QString& s) {
+  QUuid id(s);
+  return id.isNull() ? s : id.toString(QUuid::Id128);
+}
+
+static QString expandId(const QString& s) {
+  if (s.size() == 32) {
+    QUuid id = QUuid::fromRfc4122(QByteArray::fromHex(s.toLatin1()));
+    if (!id.isNull()) {
+      return id.toString();
+    }
+  }
+  return s;
+}
+
+static void compactMember(QJsonObject& o) {
+  o["id"] = compactId(o.value("id").toString());
+  QJsonArray children;
+  for (const QJsonValue& child : o.value("children").toArray()) {
+    children.push_back(compactId(child.toString()));
+  }
+  o["children"] = children;
+  o.remove("parentId");
+  o.remove("indexAsChild");
+  for (const char* key : {"title", "name", "spouseName", "note", "portrait"}) {
+    if (o.value(key).toString("-") == "") {
+      o.remove(key);
+    }
+  }
+  for (const char* key : {"isMale", "isAlive", "isSpouseAlive"}) {
+    if (!o.value(key).toBool()) {
+      o.remove(key);
+    }
+  }
+  if (o.value("children").toArray().isEmpty()) {
+    o.remove("children");
+  }
+}
+
+static void expandMember(QJsonObject& o) {
+  o["id"] = expandId(o.value("id").toString());
+  QJsonArray children;
+  for (const QJsonValue& child : o.value("children").toArray()) {
+    children.push_back(expandId(child.toString()));
+  }
+  o["children"] = children;
+}
+
+// Restores the links compactMember() leaves out.
+static void linkChildren(std::map<MemberId, FamilyMember>& members) {
+  for (const auto& pair : members) {
+    const std::vector<MemberId>& children = pair.second.children;
+    for (size_t i = 0; i < children.size(); i++) {
+      auto iter = members.find(children[i]);
+      if (iter != members.end()) {
+        iter->second.parentId = pair.first;
+        iter->second.indexAsChild = i;
+      }
+    }
+  }
+}
+
+static bool writeAll(QIODevice& file, const QByteArray& data) { return file.write(data) == data.size(); }
+
+static bool writeBlock(QIODevice& file, const QByteArray& data) {
+  uchar size[4];
+  qToBigEndian<quint32>(data.size(), size);
+  return writeAll(file, QByteArray(reinterpret_cast<const char*>(size), sizeof(size))) && writeAll(file, data);
+}
+
+// Never ends on the first half of a surrogate pair.
+static QString notePreview(const QString& body) {
+  int length = kNotePreviewLength;
+  if (body.size() > length && body[length - 1].isHighSurrogate()) {
+    length--;
+  }
+  return body.left(length);
+}
+
+// Inflates one block at a time, so only a single compressed block is held next to the json.
+static bool readCompressed(QFile& file, QByteArray& json) {
+  file.read(kCompressedMagic.size());
+  while (true) {
+    QByteArray size = file.read(4);
+    if (size.size() != 4) {
+      return false;
+    }
+    qint64 blockSize = qFromBigEndian<quint32>(size.constData());
+    if (blockSize == 0) {
+      return true;
+    }
+    // Lengths come from the file, a damaged one must not turn into a huge allocation.
+    if (blockSize < 4 || blockSize > kMaxCompressedBlockSize || blockSize > file.bytesAvailable()) {
+      qDebug() << "bad block size" << blockSize;
+      return false;
+    }
+    QByteArray block = file.read(blockSize);
+    if (block.size() != blockSize || qFromBigEndian<quint32>(block.constData()) > kReadChunkSize) {
+      return false;
+    }
+    QByteArray data = qUncompress(block);
+    if (data.isEmpty()) {
+      return false;
+    }
+    json.append(data);
+  }
+}
 
 QString Family::toJson() const {
   Q_ASSERT(isValid());
   if (!isValid()) {
     return "";
   }
+  return toJsonDocument(nullptr, nullptr).toJson();
+}
+
+QJsonDocument Family::toJsonDocument(QByteArray* notes, std::vector<NoteRef>* noteRefs, bool isCompact) const {
+
+  // Strings used more than once go to a shared table and members refer to them by index.
+  std::unordered_map<QString, int> useCounts;
+  for (const auto& pair : m_idToMember) {
+    const FamilyMember& member = pair.second;
+    for (const QString* s : {&member.title, &member.name, &member.spouseName, &member.note}) {
+      if (!s->isEmpty()) {
+        useCounts[*s]++;
+      }
+    }
+  }
+  QJsonArray strings;
+  FamilyMember::StringTable stringTable;
+  for (const auto& pair : m_idToMember) {
+    const FamilyMember& member = pair.second;
+    for (const QString* s : {&member.title, &member.name, &member.spouseName, &member.note}) {
+      if (!s->isEmpty() && useCounts[*s] > 1 && stringTable.emplace(*s, static_cast<int>(strings.size())).second) {
+        strings.push_back(*s);
+      }
+    }
+  }
 
   QJsonObject o;
-  o["rootId"] = m_rootId;
+  o["version"] = kFileVersion;
+  o["rootId"] = isCompact ? compactId(memberIdToString(m_rootId)) : memberIdToString(m_rootId);
   o["title"] = m_title;
-  o["members"] = [this]() -> QJsonArray {
+  o["strings"] = strings;
+  if (isCompact) {
+    o["compact"] = true;
+  }
+  o["members"] = [this, &stringTable, notes, noteRefs, isCompact]() -> QJsonArray {
     QJsonArray a;
+    auto push = [&a, isCompact](QJsonObject mo) {
+      if (isCompact) {
+        compactMember(mo);
+      }
+      a.push_back(mo);
+    };
     for (const auto& pair : m_idToMember) {
-      a.push_back(pair.second.toJson());
+      const FamilyMember& member = pair.second;
+      bool isOutOfLine = member.noteOffset != -1;
+      if (!isOutOfLine && (notes == nullptr || member.note.size() <= kNotePreviewLength)) {
+        push(member.toJson(&stringTable));
+        continue;
+      }
+      FamilyMember written = member;
+      QString body = isOutOfLine ? fullNote(member.id) : member.note;
+      if (notes == nullptr) {
+        written.note = body;
+        written.noteOffset = -1;
+        written.noteSize = 0;
+      } else {
+        QByteArray utf8 = body.toUtf8();
+        written.note = notePreview(body);
+        written.noteOffset = notes->size();
+        written.noteSize = utf8.size();
+        written.noteHash = isOutOfLine ? member.noteHash : noteHash(body);
+        notes->append(utf8);
+        noteRefs->push_back({member.id, written.note, written.noteOffset, written.noteSize, written.noteHash});
+      }
+      push(written.toJson(&stringTable));
     }
     return a;
   }();
 
-  return QJsonDocument(o).toJson();
+  return QJsonDocument(o);
+}
+
+bool Family::save(const QString& path) {
+  TRACE_SCOPE("Family::save");
+  Q_ASSERT(isValid());
+  if (!isValid()) {
+    return false;
+  }
+  // Serialize first, bodies that are still out of line are read from the file being replaced.
+  bool isCompressed = path.endsWith(kCompressedSuffix, Qt::CaseInsensitive);
+  QByteArray notes;
+  std::vector<NoteRef> noteRefs;
+  QJsonDocument d = toJsonDocument(&notes, &noteRefs, isCompressed);
+  QByteArray json = d.toJson(isCompressed ? QJsonDocument::Compact : QJsonDocument::Indented);
+
+  // Written to a temporary file that replaces the old one only once complete, so a failed save leaves the old file,
+  // and the bodies that only exist in it, untouched.
+  QSaveFile file(path);
+  if (!file.open(QFile::WriteOnly)) {
+    qDebug() << "can't open" << path;
+    return false;
+  }
+  bool ret = true;
+  qint64 notesBase = json.size() + 1;
+  if (isCompressed) {
+    ret = writeAll(file, kCompressedMagic);
+    for (qint64 pos = 0; ret && pos < json.size(); pos += kReadChunkSize) {
+      ret = writeBlock(file, qCompress(json.mid(pos, kReadChunkSize)));
+    }
+    ret = ret && writeBlock(file, QByteArray());
+    notesBase = file.pos();
+    ret = ret && writeAll(file, notes);
+  } else {
+    ret = writeAll(file, json);
+    if (!notes.isEmpty()) {
+      ret = ret && writeAll(file, QByteArray(1, kNotesSeparator)) && writeAll(file, notes);
+    }
+  }
+  if (!ret) {
+    qDebug() << "can't write" << path << file.errorString();
+    file.cancelWriting();
+    return false;
+  }
+  // Readers on other threads, e.g. of a snapshot, must be done with the old bodies before they are replaced.
+  QString oldNotesPath = m_noteStore.path();
+  qint64 oldNotesBase = m_noteStore.base();
+  m_noteStore.invalidate();
+  if (!file.commit()) {
+    qDebug() << "can't replace" << path << file.errorString();
+    if (oldNotesPath != "") {
+      m_noteStore.open(oldNotesPath, oldNotesBase);
+    }
+    return false;
+  }
+
+  for (const NoteRef& ref : noteRefs) {
+    FamilyMember& member = m_idToMember[ref.id];
+    member.note = m_stringPool.intern(ref.preview);
+    member.noteOffset = ref.offset;
+    member.noteSize = ref.size;
+    member.noteHash = ref.hash;
+    m_snapshotBuilder.touch(ref.id);
+  }
+  sweepStrings(true);
+  if (!notes.isEmpty()) {
+    m_noteStore.open(path, notesBase);
+  }
+  return true;
+}
+
+Family* Family::load(const QString& path) {
+  TRACE_SCOPE("Family::load");
+  QFile file(path);
+  if (!file.open(QFile::ReadOnly)) {
+    qDebug() << "can't open" << path;
+    return nullptr;
+  }
+  // Only the json part is read, note bodies stay in the file until they are asked for.
+  QByteArray json;
+  qint64 notesBase = -1;
+  if (file.peek(kCompressedMagic.size()) == kCompressedMagic) {
+    if (!readCompressed(file, json)) {
+      qDebug() << "truncated or corrupt" << path;
+      return nullptr;
+    }
+    notesBase = file.atEnd() ? -1 : file.pos();
+  } else {
+    while (!file.atEnd()) {
+      QByteArray chunk = file.read(kReadChunkSize);
+      int separator = chunk.indexOf(kNotesSeparator);
+      if (separator != -1) {
+        json.append(chunk.left(separator));
+        notesBase = json.size() + 1;
+        break;
+      }
+      json.append(chunk);
+    }
+  }
+  Family* result = fromJson(json);
+  if (result && notesBase != -1) {
+    result->m_noteStore.open(path, notesBase);
+    result->hashOldNotes();
+  }
+  return result;
+}
+
+QString Family::fullNote(const MemberId& id) const {
+  auto iter = m_idToMember.find(id);
+  if (iter == m_idToMember.end()) {
+    return "";
+  }
+  const FamilyMember& member = iter->second;
+  if (member.noteOffset == -1 || !m_noteStore.isOpen()) {
+    return member.note;
+  }
+  QString result = m_noteStore.read(member.noteOffset, member.noteSize);
+  return result.isNull() ? member.note : result;
 }
 
-Family* Family::fromJson(const QString& json) {
-  QJsonDocument d = QJsonDocument::fromJson(json.toUtf8());
+Family* Family::fromJson(const QString& json) { return fromJson(json.toUtf8()); }
+
+Family* Family::fromJson(const QByteArray& json) {
+  TRACE_SCOPE("Family::fromJson");
+  QJsonDocument d = QJsonDocument::fromJson(json);
   if (!d.isObject()) {
     qDebug() << "not a valid json" << json;
     return nullptr;
   }
 
-  Family* result = new Family;
   QJsonObject o = d.object();
-  result->m_rootId = o["rootId"].toString();
+  if (o["version"].toInt(1) > kFileVersion) {
+    qDebug() << "file version" << o["version"].toInt() << "is newer than" << kFileVersion;
+    return nullptr;
+  }
+  bool isCompact = o["compact"].toBool();
+  Family* result = new Family;
+  result->m_rootId = memberIdFromString(isCompact ? expandId(o["rootId"].toString()) : o["rootId"].toString());
   result->m_title = o["title"].toString();
   if (result->m_title == "") {
     result->m_title = kDefaultFamilyTitle;
   }
-  result->m_idToMember = [&o]() -> std::map<QString, FamilyMember> {
-    std::map<QString, FamilyMember> result;
+  QStringList strings;
+  for (const QJsonValue& sv : o["strings"].toArray()) {
+    strings.push_back(result->m_stringPool.intern(sv.toString()));
+  }
+  result->m_idToMember = [&o, &strings, isCompact, family = result]() -> std::map<MemberId, FamilyMember> {
+    std::map<MemberId, FamilyMember> result;
     QJsonValue v = o["members"];
     Q_ASSERT(v.isArray());
     if (!v.isArray()) {
@@ -78,128 +437,583 @@ Family* Family::fromJson(const QString& json) {
         continue;
       }
       QJsonObject mo = mv.toObject();
-      FamilyMember member = FamilyMember::fromJson(mo);
+      if (isCompact) {
+        expandMember(mo);
+      }
+      FamilyMember member = FamilyMember::fromJson(mo, &strings);
       Q_ASSERT(member.isValid());
       if (!member.isValid()) {
         continue;
       }
+      family->internStrings(member);
       result[member.id] = member;
     }
     return result;
   }();
+  if (isCompact) {
+    linkChildren(result->m_idToMember);
+  }
+  result->m_searchIndex.clear();
+  result->m_pinyinIndex.clear();
+  for (const auto& pair : result->m_idToMember) {
+    result->m_searchIndex.update(pair.second);
+    result->m_pinyinIndex.update(pair.second);
+  }
+  result->m_ancestryIndex.build(result->m_rootId, result->m_idToMember);
+  result->m_topology.build(result->m_rootId, result->m_idToMember);
+  result->updateHashes();
+  result->m_snapshotBuilder.reset();
+  result->m_sweptPoolSize = result->m_stringPool.size();
   result->setIsDirty(false);
   return result;
 }
 
+// Files from before noteHash was written, their bodies are read once so the content hash covers them.
+void Family::hashOldNotes() {
+  bool isChanged = false;
+  for (auto& pair : m_idToMember) {
+    FamilyMember& member = pair.second;
+    if (member.noteOffset != -1 && member.noteHash == 0) {
+      member.noteHash = noteHash(m_noteStore.read(member.noteOffset, member.noteSize));
+      isChanged = true;
+    }
+  }
+  if (isChanged) {
+    updateHashes();
+    m_snapshotBuilder.reset();
+    setIsDirty(false);
+  }
+}
+
+std::vector<FamilyValidator::Problem> Family::validate() const {
+  TRACE_SCOPE("Family::validate");
+  return FamilyValidator::validate(m_rootId, m_idToMember);
+}
+
+int Family::repair() {
+  int result = FamilyValidator::repair(m_rootId, m_idToMember);
+  if (result > 0) {
+    m_ancestryIndex.build(m_rootId, m_idToMember);
+    m_topology.build(m_rootId, m_idToMember);
+    updateHashes();
+    m_snapshotBuilder.reset();
+    setIsDirty(true);
+  }
+  return result;
+}
+
 QString Family::title() const { return m_title; }
 
-void Family::addChild(const QString& parentId, const FamilyMember& child) {
+void Family::addChild(const MemberId& parentId, const FamilyMember& child) {
   Q_ASSERT(child.isValid());
   Q_ASSERT(m_idToMember.count(parentId));
   Q_ASSERT(!m_idToMember.count(child.id));
 
   m_idToMember[child.id] = child;
+  internStrings(m_idToMember[child.id]);
   m_idToMember[child.id].parentId = parentId;
   m_idToMember[child.id].indexAsChild = m_idToMember[parentId].children.size();
 
   m_idToMember[parentId].children.push_back(child.id);
+  m_searchIndex.update(m_idToMember[child.id]);
+  m_pinyinIndex.update(m_idToMember[child.id]);
+  m_ancestryIndex.addLeaf(parentId, child.id);
+  m_topology.addLeaf(parentId, &m_idToMember[child.id]);
+  updateHashPath(child.id);
 
-  relayout();
-  setIsDirty(true);
+  updateLayout();
+  updateIsDirty();
 }
 
-void Family::reorderChildren(const QString& parentId, const std::vector<QString>& children) {
+void Family::reorderChildren(const MemberId& parentId, const std::vector<MemberId>& children) {
   Q_ASSERT(m_idToMember.count(parentId));
   Q_ASSERT(
-      std::unordered_set<QString>(m_idToMember[parentId].children.begin(), m_idToMember[parentId].children.end()) ==
-      std::unordered_set<QString>(children.begin(), children.end()));
+      std::unordered_set<MemberId, MemberIdHash>(m_idToMember[parentId].children.begin(),
+                                                 m_idToMember[parentId].children.end()) ==
+      std::unordered_set<MemberId, MemberIdHash>(children.begin(), children.end()));
   if (m_idToMember[parentId].children == children) {
     return;
   }
   m_idToMember[parentId].children = children;
+  reindexChildren(parentId);
+  updateHashPath(parentId);
   relayout();
-  setIsDirty(true);
+  updateIsDirty();
+}
+
+std::vector<FamilyMember> Family::copySubtree(const MemberId& id) const {
+  std::vector<FamilyMember> result;
+  auto root = m_idToMember.find(id);
+  Q_ASSERT(root != m_idToMember.end());
+  if (root == m_idToMember.end()) {
+    return result;
+  }
+  result.push_back(root->second);
+  for (size_t i = 0; i < result.size(); i++) {
+    for (const MemberId& childId : result[i].children) {
+      result.push_back(m_idToMember.at(childId));
+    }
+  }
+  for (FamilyMember& member : result) {
+    if (member.noteOffset != -1) {
+      member.note = fullNote(member.id);
+      member.noteOffset = -1;
+      member.noteSize = 0;
+    }
+    member.clearLayoutValue();
+  }
+  return result;
+}
+
+void Family::insertSubtree(const MemberId& parentId, int index, const std::vector<FamilyMember>& members) {
+  Q_ASSERT(!members.empty());
+  Q_ASSERT(m_idToMember.count(parentId));
+  if (members.empty() || !m_idToMember.count(parentId)) {
+    return;
+  }
+  for (const FamilyMember& member : members) {
+    Q_ASSERT(member.isValid() && !m_idToMember.count(member.id));
+    FamilyMember& inserted = m_idToMember[member.id];
+    inserted = member;
+    internStrings(inserted);
+    m_snapshotBuilder.touch(member.id);
+    m_searchIndex.update(inserted);
+    m_pinyinIndex.update(inserted);
+  }
+  const MemberId& rootId = members.front().id;
+  m_idToMember[rootId].parentId = parentId;
+  std::vector<MemberId>& siblings = m_idToMember[parentId].children;
+  index = std::clamp(index, 0, static_cast<int>(siblings.size()));
+  siblings.insert(siblings.begin() + index, rootId);
+  reindexChildren(parentId);
+
+  rebuildStructure();
+  updateIsDirty();
+}
+
+std::vector<FamilyMember> Family::removeSubtree(const MemberId& id) {
+  Q_ASSERT(id != m_rootId);
+  if (id == m_rootId || !m_idToMember.count(id)) {
+    return {};
+  }
+  std::vector<FamilyMember> result = copySubtree(id);
+  MemberId parentId = m_idToMember[id].parentId;
+  std::vector<MemberId>& siblings = m_idToMember[parentId].children;
+  siblings.erase(std::find(siblings.begin(), siblings.end(), id));
+  reindexChildren(parentId);
+  for (const FamilyMember& member : result) {
+    m_idToMember.erase(member.id);
+    m_snapshotBuilder.touch(member.id);
+    m_searchIndex.remove(member.id);
+    m_pinyinIndex.remove(member.id);
+  }
+  sweepStrings(false);
+
+  rebuildStructure();
+  updateIsDirty();
+  return result;
+}
+
+bool Family::canMoveSubtree(const MemberId& id, const MemberId& newParentId) const {
+  if (id == m_rootId || !m_idToMember.count(id) || !m_idToMember.count(newParentId)) {
+    return false;
+  }
+  // The new parent must not be inside the branch itself.
+  return m_ancestryIndex.lowestCommonAncestor(id, newParentId) != id;
+}
+
+void Family::moveSubtree(const MemberId& id, const MemberId& newParentId, int index) {
+  Q_ASSERT(canMoveSubtree(id, newParentId));
+  if (!canMoveSubtree(id, newParentId)) {
+    return;
+  }
+  MemberId oldParentId = m_idToMember[id].parentId;
+  std::vector<MemberId>& oldSiblings = m_idToMember[oldParentId].children;
+  oldSiblings.erase(std::find(oldSiblings.begin(), oldSiblings.end(), id));
+  reindexChildren(oldParentId);
+
+  std::vector<MemberId>& siblings = m_idToMember[newParentId].children;
+  index = std::clamp(index, 0, static_cast<int>(siblings.size()));
+  siblings.insert(siblings.begin() + index, id);
+  m_idToMember[id].parentId = newParentId;
+  reindexChildren(newParentId);
+
+  rebuildStructure();
+  updateIsDirty();
+}
+
+void Family::replaceMembers(const QString& title, const std::map<MemberId, FamilyMember>& members) {
+  TRACE_SCOPE("Family::replaceMembers");
+  Q_ASSERT(members.count(m_rootId));
+  if (!members.count(m_rootId)) {
+    return;
+  }
+  for (const auto& pair : m_idToMember) {
+    if (!members.count(pair.first)) {
+      m_searchIndex.remove(pair.first);
+      m_pinyinIndex.remove(pair.first);
+    }
+  }
+  std::vector<MemberId> updatedIds;
+  std::map<MemberId, FamilyMember> old;
+  old.swap(m_idToMember);
+  m_idToMember = members;
+  for (auto& pair : m_idToMember) {
+    FamilyMember& member = pair.second;
+    internStrings(member);
+    auto iter = old.find(pair.first);
+    bool isNew = iter == old.end();
+    if (isNew || FamilyDiff::changedFields(iter->second, member) != 0) {
+      m_searchIndex.update(member);
+      m_pinyinIndex.update(member);
+      if (!isNew) {
+        updatedIds.push_back(member.id);
+      }
+    }
+  }
+  bool isTitleChanged = title != m_title;
+  m_title = title;
+  sweepStrings(false);
+
+  m_snapshotBuilder.reset();
+  rebuildStructure();
+  for (const MemberId& id : updatedIds) {
+    emit memberUpdated(id);
+  }
+  if (isTitleChanged) {
+    emit titleUpdated();
+  }
+  updateIsDirty();
+}
+
+void Family::remapIds(std::vector<FamilyMember>& members) {
+  std::unordered_map<MemberId, MemberId, MemberIdHash> oldToNew;
+  oldToNew.reserve(members.size());
+  for (FamilyMember& member : members) {
+    MemberId newId = QUuid::createUuid();
+    oldToNew[member.id] = newId;
+    member.id = newId;
+  }
+  for (size_t i = 0; i < members.size(); i++) {
+    FamilyMember& member = members[i];
+    if (i > 0) {
+      member.parentId = oldToNew.at(member.parentId);
+    }
+    for (MemberId& childId : member.children) {
+      childId = oldToNew.at(childId);
+    }
+  }
+}
+
+void Family::reindexChildren(const MemberId& parentId) {
+  const std::vector<MemberId>& children = m_idToMember[parentId].children;
+  m_snapshotBuilder.touch(parentId);
+  for (size_t i = 0; i < children.size(); i++) {
+    m_idToMember[children[i]].indexAsChild = i;
+    m_snapshotBuilder.touch(children[i]);
+  }
+}
+
+void Family::rebuildStructure() {
+  m_ancestryIndex.build(m_rootId, m_idToMember);
+  m_topology.build(m_rootId, m_idToMember);
+  updateHashes();
+  updateLayout();
 }
 
 void Family::updateMember(const FamilyMember& member) {
   Q_ASSERT(member.isValid());
-  m_idToMember[member.id] = member;
+  Q_ASSERT(m_idToMember.count(member.id));
+  FamilyMember& old = m_idToMember[member.id];
+  int livingDelta = int(member.isAlive) - int(old.isAlive);
+  int maleDelta = int(member.isMale) - int(old.isMale);
+  FamilyMember updated = member;
+  updated._layer = old._layer;
+  updated._indexInSubTree = old._indexInSubTree;
+  updated._subTreeWidth = old._subTreeWidth;
+  updated._stats = old._stats;
+  internStrings(updated);
+  old = updated;
+  if (livingDelta != 0 || maleDelta != 0) {
+    for (MemberId id = member.id; !id.isNull(); id = m_idToMember[id].parentId) {
+      SubTreeStats& stats = m_idToMember[id]._stats;
+      stats.livingCount += livingDelta;
+      stats.maleCount += maleDelta;
+      stats.femaleCount -= maleDelta;
+    }
+  }
+  m_searchIndex.update(member);
+  m_pinyinIndex.update(member);
+  updateHashPath(member.id);
+  sweepStrings(false);
   emit memberUpdated(member.id);
-  setIsDirty(true);
+  updateIsDirty();
 }
 
 bool Family::isDirty() const { return m_isDirty; }
 
 void Family::setIsDirty(bool newIsDirty) {
+  if (!newIsDirty) {
+    m_cleanHash = contentHash();
+  }
   if (m_isDirty == newIsDirty) return;
   m_isDirty = newIsDirty;
   emit isDirtyChanged();
 }
 
-QString Family::rootId() const { return m_rootId; }
+// Dirty while the content differs from the last clean state, so an edit reverted by hand or by undo is clean again.
+void Family::updateIsDirty() { setIsDirty(contentHash() != m_cleanHash); }
+
+std::shared_ptr<const FamilySnapshot> Family::snapshot() {
+  return m_snapshotBuilder.build(m_rootId, m_title, contentHash(), m_noteStore, m_idToMember);
+}
+
+quint64 Family::contentHash() const {
+  auto root = m_idToMember.find(m_rootId);
+  return combineHash(hashString(kHashSeed, m_title), root == m_idToMember.end() ? 0 : root->second._subTreeHash);
+}
+
+quint64 Family::subTreeHash(const MemberId& id) const {
+  auto iter = m_idToMember.find(id);
+  return iter == m_idToMember.end() ? 0 : iter->second._subTreeHash;
+}
+
+void Family::updateHashes() {
+  for (int i = m_topology.size() - 1; i >= 0; i--) {
+    FamilyMember& member = m_topology.memberAt(i);
+    quint64 hash = memberHash(member);
+    for (int child = m_topology.childBegin(i); child < m_topology.childEnd(i); child++) {
+      hash = combineHash(hash, m_topology.memberAt(child)._subTreeHash);
+    }
+    // Any change to a member's fields or children shows up in its hash, so this also finds what a snapshot must copy.
+    if (member._subTreeHash != hash) {
+      member._subTreeHash = hash;
+      m_snapshotBuilder.touch(member.id);
+    }
+  }
+}
+
+void Family::updateHashPath(const MemberId& id) {
+  for (MemberId cur = id; !cur.isNull();) {
+    FamilyMember& member = m_idToMember[cur];
+    quint64 hash = memberHash(member);
+    for (const MemberId& childId : member.children) {
+      auto iter = m_idToMember.find(childId);
+      if (iter != m_idToMember.end()) {
+        hash = combineHash(hash, iter->second._subTreeHash);
+      }
+    }
+    member._subTreeHash = hash;
+    m_snapshotBuilder.touch(cur);
+    cur = member.parentId;
+  }
+}
+
+MemberId Family::rootId() const { return m_rootId; }
 
 void Family::relayout() {
+  TRACE_SCOPE("Family::relayout");
   Q_ASSERT(isValid());
   if (!isValid()) {
     return;
   }
+  QElapsedTimer timer;
+  timer.start();
+  m_topology.build(m_rootId, m_idToMember);
+  updateLayout();
+  PerfStats::relayoutNs = timer.nsecsElapsed();
+}
+
+void Family::updateLayout() {
+  TRACE_SCOPE("Family::updateLayout");
+  QElapsedTimer timer;
+  timer.start();
   for (auto& pair : m_idToMember) {
     pair.second.clearLayoutValue();
   }
-  int layer = 0;
-  std::vector<QString> layerIds({m_rootId});
-  while (layerIds.size() > 0) {
-    std::vector<QString> nextLayerIds;
-    for (const QString& id : layerIds) {
-      Q_ASSERT(m_idToMember.count(id));
-      if (!m_idToMember.count(id)) {
-        qDebug() << "no id:" << id;
-        continue;
-      }
-      FamilyMember& member = m_idToMember[id];
-      Q_ASSERT(member.isValid());
-      if (!member.isValid()) {
-        qDebug() << "member is not valid:" << id;
-        continue;
-      }
-      Q_ASSERT(member._layer == 0);
-      member._layer = layer;
-      // qDebug() << member.id << member.name << "layer:" << layer;
-      nextLayerIds.insert(nextLayerIds.end(), member.children.begin(), member.children.end());
-      // qDebug() << "==========";
+  for (int i = 0; i < m_topology.size(); i++) {
+    m_topology.memberAt(i)._layer = m_topology.layer(i);
+  }
+  // Children come after their parent in breadth-first order, so a reverse scan finishes every subtree before its root.
+  for (int i = m_topology.size() - 1; i >= 0; i--) {
+    FamilyMember& member = m_topology.memberAt(i);
+    SubTreeStats& stats = member._stats;
+    stats = SubTreeStats();
+    stats.livingCount = member.isAlive ? 1 : 0;
+    stats.maleCount = member.isMale ? 1 : 0;
+    stats.femaleCount = member.isMale ? 0 : 1;
+    int width = 0;
+    for (int child = m_topology.childBegin(i); child < m_topology.childEnd(i); child++) {
+      const FamilyMember& childMember = m_topology.memberAt(child);
+      width += childMember._subTreeWidth;
+      stats.memberCount += childMember._stats.memberCount;
+      stats.livingCount += childMember._stats.livingCount;
+      stats.maleCount += childMember._stats.maleCount;
+      stats.femaleCount += childMember._stats.femaleCount;
+      stats.depth = std::max(stats.depth, childMember._stats.depth + 1);
     }
-    layerIds.swap(nextLayerIds);
-    layer++;
+    member._subTreeWidth = std::max(width, 1);
   }
-  updateSubTreeWidth(m_rootId);
+  PerfStats::relayoutNs = timer.nsecsElapsed();
   emit relayouted();
 }
 
-int Family::updateSubTreeWidth(const QString& id) {
-  Q_ASSERT(m_idToMember.count(id));
-  FamilyMember& member = m_idToMember[id];
-  Q_ASSERT(member.isValid());
-  if (member.children.empty()) {
-    member._subTreeWidth = 1;
-    return 1;
+int Family::layerCount() const { return m_topology.layerCount(); }
+
+const FamilyTopology& Family::topology() const { return m_topology; }
+
+void Family::reportMemory(MemoryReport& report) const {
+  qint64 childBytes = 0;
+  qint64 stringCount = 0;
+  qint64 stringBytes = 0;
+  // Interned strings share a buffer, count each buffer once.
+  std::unordered_set<const QChar*> seen;
+  for (const auto& pair : m_idToMember) {
+    const FamilyMember& member = pair.second;
+    childBytes += member.children.capacity() * sizeof(MemberId);
+    for (const QString* s : {&member.title, &member.name, &member.spouseName, &member.note, &member.portrait}) {
+      if (!s->isEmpty() && seen.insert(s->constData()).second) {
+        stringCount++;
+        stringBytes += MemoryReport::stringBytes(*s);
+      }
+    }
   }
-  int result = 0;
-  for (const QString& childId : member.children) {
-    result += updateSubTreeWidth(childId);
+  qint64 size = m_idToMember.size();
+  report.add("Member map", size, size * (sizeof(*m_idToMember.begin()) + MemoryReport::kTreeNodeOverhead));
+  report.add("Member children", size, childBytes);
+  report.add("Member strings", stringCount, stringBytes);
+  report.add("String pool", m_stringPool.size(), m_stringPool.memoryUsage());
+  report.add("Topology", m_topology.size(), m_topology.memoryUsage());
+  report.add("Ancestry index", m_ancestryIndex.size(), m_ancestryIndex.memoryUsage());
+  report.add("Search index", m_searchIndex.size(), m_searchIndex.memoryUsage());
+  report.add("Pinyin index", m_pinyinIndex.size(), m_pinyinIndex.memoryUsage());
+}
+
+SubTreeStats Family::subTreeStats(const MemberId& id) const {
+  auto iter = m_idToMember.find(id);
+  if (iter == m_idToMember.end()) {
+    return SubTreeStats();
   }
-  member._subTreeWidth = result;
-  // qDebug() << member.name << "subTreeWidth:" << result;
-  return result;
+  return iter->second._stats;
 }
 
-FamilyMember Family::getMember(const QString& id) {
+FamilyMember Family::getMember(const MemberId& id) {
   if (m_idToMember.count(id)) {
     return m_idToMember[id];
   }
   return FamilyMember();
 }
 
-QString Family::getParentId(const QString& id) { return getMember(id).parentId; }
+const std::map<MemberId, FamilyMember>& Family::members() const { return m_idToMember; }
+
+MemberId Family::getParentId(const MemberId& id) { return getMember(id).parentId; }
+
+std::vector<MemberId> Family::search(const QString& text, FamilySearchIndex::Match match) const {
+  return m_searchIndex.search(text, match);
+}
+
+const FamilySearchIndex& Family::searchIndex() const { return m_searchIndex; }
+
+std::vector<FamilyPinyinIndex::Result> Family::searchPinyin(const QString& text) const {
+  return m_pinyinIndex.search(text);
+}
+
+const FamilyAncestryIndex& Family::ancestryIndex() const { return m_ancestryIndex; }
+
+static QString descendantTerm(int generations, bool isMale) {
+  switch (generations) {
+    case 1:
+      return isMale ? "儿子" : "女儿";
+    case 2:
+      return isMale ? "孙子" : "孙女";
+    case 3:
+      return isMale ? "曾孙" : "曾孙女";
+    case 4:
+      return isMale ? "玄孙" : "玄孙女";
+    default:
+      return QString("%1代孙%2").arg(generations).arg(isMale ? "" : "女");
+  }
+}
+
+static QString ancestorTerm(int generations, bool isMale) {
+  static const char* kPrefixes[] = {"", "", "祖", "曾祖", "高祖", "天祖", "烈祖"};
+  if (generations == 1) {
+    return isMale ? "父亲" : "母亲";
+  }
+  if (generations < static_cast<int>(std::size(kPrefixes))) {
+    return QString(kPrefixes[generations]) + (isMale ? "父" : "母");
+  }
+  return QString("%1代祖").arg(generations);
+}
+
+QString Family::kinshipTerm(const MemberId& fromId, const MemberId& toId) const {
+  const FamilyAncestryIndex& index = m_ancestryIndex;
+  int from = index.indexOf(fromId);
+  int to = index.indexOf(toId);
+  if (from == -1 || to == -1) {
+    return "";
+  }
+  int lca = index.lowestCommonAncestor(from, to);
+  int up = index.depth(from) - index.depth(lca);
+  int down = index.depth(to) - index.depth(lca);
+  bool isMale = m_idToMember.at(toId).isMale;
+
+  if (up == 0 && down == 0) {
+    return "本人";
+  }
+  if (up == 0) {
+    return descendantTerm(down, isMale);
+  }
+  if (down == 0) {
+    return ancestorTerm(up, isMale);
+  }
+
+  // Collateral relatives: compare the two branches right below the common ancestor.
+  const FamilyMember& fromBranch = m_idToMember.at(index.idAt(index.levelAncestor(from, index.depth(lca) + 1)));
+  const FamilyMember& toBranch = m_idToMember.at(index.idAt(index.levelAncestor(to, index.depth(lca) + 1)));
+  const std::vector<MemberId>& branches = m_idToMember.at(index.idAt(lca)).children;
+  bool toIsElder = std::find(branches.begin(), branches.end(), toBranch.id) <
+                   std::find(branches.begin(), branches.end(), fromBranch.id);
+  auto isPaternalLine = [this, &index](int member, int ancestorDepth) {
+    for (; index.depth(member) > ancestorDepth; member = index.levelAncestor(member, index.depth(member) - 1)) {
+      if (!m_idToMember.at(index.idAt(member)).isMale) {
+        return false;
+      }
+    }
+    return true;
+  };
+  bool isPaternal = isPaternalLine(index.levelAncestor(from, index.depth(from) - 1), index.depth(lca)) &&
+                    isPaternalLine(index.levelAncestor(to, index.depth(to) - 1), index.depth(lca));
+
+  if (up == 1 && down == 1) {
+    return toIsElder ? (isMale ? "哥哥" : "姐姐") : (isMale ? "弟弟" : "妹妹");
+  }
+  if (up == 1 && down <= 3) {
+    bool viaBrother = isPaternalLine(index.levelAncestor(to, index.depth(to) - 1), index.depth(lca));
+    return QString(viaBrother ? "侄" : "外甥") + (down == 2 ? (isMale ? "子" : "女") : (isMale ? "孙" : "孙女"));
+  }
+  if (down == 1 && up <= 3) {
+    QString generation = up == 2 ? "" : "祖";
+    if (!isPaternalLine(index.levelAncestor(from, index.depth(from) - 1), index.depth(lca))) {
+      return isMale ? "舅" + generation + "父" : "姨" + generation + "母";
+    }
+    return isMale ? (toIsElder ? "伯" : "叔") + generation + "父" : "姑" + generation + "母";
+  }
+  if (up == down) {
+    QString prefix = up == 2 ? (isPaternal ? "堂" : "表") : up == 3 ? "再从" : "族";
+    return prefix + (isMale ? "兄弟" : "姐妹");
+  }
+  if (up == 2 && down == 3) {
+    return QString(isPaternal ? "堂" : "表") + (isMale ? "侄" : "侄女");
+  }
+  if (up == 3 && down == 2) {
+    return QString(isPaternal ? "堂" : "表") + (isMale ? (toIsElder ? "伯父" : "叔父") : "姑母");
+  }
+  if (down > up) {
+    return QString("旁系晚辈（低%1代）").arg(down - up);
+  }
+  return QString("旁系长辈（高%1代）").arg(up - down);
+}
 
 void Family::updateTitle(const QString& title) {
   if (title == "") {
@@ -208,15 +1022,44 @@ void Family::updateTitle(const QString& title) {
     m_title = title;
   }
   emit titleUpdated();
-  setIsDirty(true);
+  updateIsDirty();
+}
+
+void Family::internStrings(FamilyMember& member) {
+  member.title = m_stringPool.intern(member.title);
+  member.name = m_stringPool.intern(member.name);
+  member.spouseName = m_stringPool.intern(member.spouseName);
+  member.note = m_stringPool.intern(member.note);
+}
+
+void Family::sweepStrings(bool force) {
+  constexpr size_t kMinSweepSize = 1024;
+  if (!force && m_stringPool.size() < std::max(kMinSweepSize, m_sweptPoolSize * 2)) {
+    return;
+  }
+  m_stringPool.clear();
+  for (auto& pair : m_idToMember) {
+    internStrings(pair.second);
+  }
+  m_sweptPoolSize = m_stringPool.size();
 }
 
 void Family::clear() {
   m_idToMember.clear();
-  m_rootId = QUuid::createUuid().toString();
+  m_noteStore.close();
+  m_stringPool.clear();
+  m_rootId = QUuid::createUuid();
   m_title = kDefaultFamilyTitle;
   FamilyMember member;
   member.id = m_rootId;
   m_idToMember[member.id] = member;
+  m_searchIndex.clear();
+  m_searchIndex.update(member);
+  m_pinyinIndex.clear();
+  m_pinyinIndex.update(member);
+  m_ancestryIndex.build(m_rootId, m_idToMember);
+  m_topology.build(m_rootId, m_idToMember);
+  updateHashes();
+  m_snapshotBuilder.reset();
   setIsDirty(true);
 }
@@ -24,9 +24,20 @@
 
 #pragma once
 
+#include <QJsonDocument>
 #include <QObject>
 
+#include "familyancestryindex.h"
 #include "familymember.h"
+#include "familynotestore.h"
+#include "familypinyinindex.h"
+#include "familysearchindex.h"
+#include "familysnapshot.h"
+#include "familytopology.h"
+#include "familyvalidator.h"
+#include "stringpool.h"
+
+struct MemoryReport;
 
 class Family : public QObject {
   Q_OBJECT
@@ -37,40 +48,110 @@ class Family : public QObject {
     setIsDirty(false);
   }
 
-  bool isValid() const { return m_rootId != ""; }
+  bool isValid() const { return !m_rootId.isNull(); }
   int size() const { return m_idToMember.size(); }
   void clear();
 
   QString toJson() const;
   static Family* fromJson(const QString& json);
+  static Family* fromJson(const QByteArray& json);
+
+  // File format: the json, with long notes replaced by previews, followed by the note bodies.
+  bool save(const QString& path);
+  static Family* load(const QString& path);
+  QString fullNote(const MemberId& id) const;
+
+  std::vector<FamilyValidator::Problem> validate() const;
+  int repair();
 
   QString title() const;
-  QString rootId() const;
+  MemberId rootId() const;
   void relayout();
-  int updateSubTreeWidth(const QString& id);
+  int layerCount() const;
+  const FamilyTopology& topology() const;
+  SubTreeStats subTreeStats(const MemberId& id) const;
+  void reportMemory(MemoryReport& report) const;
+
+  FamilyMember getMember(const MemberId& id);
+  const std::map<MemberId, FamilyMember>& members() const;
+  MemberId getParentId(const MemberId& id);
+
+  std::vector<MemberId> search(const QString& text,
+                              FamilySearchIndex::Match match = FamilySearchIndex::Match::Substring) const;
+  const FamilySearchIndex& searchIndex() const;
+  std::vector<FamilyPinyinIndex::Result> searchPinyin(const QString& text) const;
 
-  FamilyMember getMember(const QString& id);
-  QString getParentId(const QString& id);
+  const FamilyAncestryIndex& ancestryIndex() const;
+  QString kinshipTerm(const MemberId& fromId, const MemberId& toId) const;
 
   void updateTitle(const QString& title);
   void updateMember(const FamilyMember& member);
-  void reorderChildren(const QString& parentId, const std::vector<QString>& children);
-  void addChild(const QString& parentId, const FamilyMember& child);
+  void reorderChildren(const MemberId& parentId, const std::vector<MemberId>& children);
+  void addChild(const MemberId& parentId, const FamilyMember& child);
+
+  // Whole branches, members[0] is the branch root and the rest follow in breadth-first order. Each operation splices
+  // the map once and does a single layout update. Notes are loaded in full so branches survive a save.
+  std::vector<FamilyMember> copySubtree(const MemberId& id) const;
+  void insertSubtree(const MemberId& parentId, int index, const std::vector<FamilyMember>& members);
+  std::vector<FamilyMember> removeSubtree(const MemberId& id);
+  bool canMoveSubtree(const MemberId& id, const MemberId& newParentId) const;
+  void moveSubtree(const MemberId& id, const MemberId& newParentId, int index);
+  // Swaps in a whole new member set with the same root in one step, e.g. the result of FamilyDiff::merge.
+  void replaceMembers(const QString& title, const std::map<MemberId, FamilyMember>& members);
+  // Gives every member a new id and rewrites the links between them, the root keeps its parentId.
+  static void remapIds(std::vector<FamilyMember>& members);
+
+  // O(edited chunks), see FamilySnapshot. Call on the GUI thread, hand the result to any thread.
+  std::shared_ptr<const FamilySnapshot> snapshot();
 
   bool isDirty() const;
   void setIsDirty(bool newIsDirty);
 
+  // Title plus the subtree hash of the root, see FamilyMember::_subTreeHash.
+  quint64 contentHash() const;
+  quint64 subTreeHash(const MemberId& id) const;
+
  signals:
   void titleUpdated();
   void relayouted();
-  void memberUpdated(const QString& id);
+  void memberUpdated(const MemberId& id);
 
   void isDirtyChanged();
 
  private:
-  QString m_rootId;
+  MemberId m_rootId;
   QString m_title;
-  std::map<QString, FamilyMember> m_idToMember;
+  std::map<MemberId, FamilyMember> m_idToMember;
+  FamilyTopology m_topology;
+  FamilySearchIndex m_searchIndex;
+  FamilyPinyinIndex m_pinyinIndex;
+  FamilyAncestryIndex m_ancestryIndex;
+
+  StringPool m_stringPool;
+  size_t m_sweptPoolSize = 0;
+  FamilyNoteStore m_noteStore;
+  FamilySnapshotBuilder m_snapshotBuilder;
 
   bool m_isDirty = false;
+  quint64 m_cleanHash = 0;
+
+  struct NoteRef {
+    MemberId id;
+    QString preview;
+    qint64 offset;
+    int size;
+    quint64 hash;
+  };
+  // Compact documents leave out default values and the links derived from the children lists, and write ids as bare
+  // hex.
+  QJsonDocument toJsonDocument(QByteArray* notes, std::vector<NoteRef>* noteRefs, bool isCompact = false) const;
+  void internStrings(FamilyMember& member);
+  void sweepStrings(bool force);
+  void hashOldNotes();
+  void updateLayout();
+  void updateIsDirty();
+  void updateHashes();
+  void updateHashPath(const MemberId& id);
+  void reindexChildren(const MemberId& parentId);
+  void rebuildStructure();
 };
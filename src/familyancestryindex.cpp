@@ -0,0 +1,158 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familyancestryindex.h"
+
+#include <QDebug>
+
+#include "memoryreport.h"
+
+void FamilyAncestryIndex::clear() {
+  m_ids.clear();
+  m_idToIndex.clear();
+  m_depth.clear();
+  m_up.clear();
+}
+
+void FamilyAncestryIndex::build(const MemberId& rootId, const std::map<MemberId, FamilyMember>& members) {
+  clear();
+  if (!members.count(rootId)) {
+    return;
+  }
+  m_ids.reserve(members.size());
+  m_depth.reserve(members.size());
+  m_up.emplace_back();
+  m_up[0].reserve(members.size());
+
+  append(-1, rootId);
+  for (size_t i = 0; i < m_ids.size(); i++) {
+    auto iter = members.find(m_ids[i]);
+    Q_ASSERT(iter != members.end());
+    for (const MemberId& childId : iter->second.children) {
+      if (!members.count(childId) || m_idToIndex.count(childId)) {
+        qDebug() << "skip child:" << childId;
+        continue;
+      }
+      append(i, childId);
+    }
+  }
+}
+
+void FamilyAncestryIndex::addLeaf(const MemberId& parentId, const MemberId& id) {
+  int parent = indexOf(parentId);
+  Q_ASSERT(parent != -1);
+  Q_ASSERT(indexOf(id) == -1);
+  if (parent == -1 || indexOf(id) != -1) {
+    return;
+  }
+  append(parent, id);
+}
+
+int FamilyAncestryIndex::indexOf(const MemberId& id) const {
+  auto iter = m_idToIndex.find(id);
+  return iter == m_idToIndex.end() ? -1 : iter->second;
+}
+
+size_t FamilyAncestryIndex::memoryUsage() const {
+  size_t result = m_ids.capacity() * sizeof(MemberId) + m_depth.capacity() * sizeof(int);
+  for (const std::vector<int>& level : m_up) {
+    result += sizeof(level) + level.capacity() * sizeof(int);
+  }
+  result += m_idToIndex.size() * (sizeof(MemberId) + sizeof(int) + MemoryReport::kHashNodeOverhead);
+  result += m_idToIndex.bucket_count() * sizeof(void*);
+  return result;
+}
+
+int FamilyAncestryIndex::lowestCommonAncestor(int a, int b) const {
+  if (m_depth[a] < m_depth[b]) {
+    std::swap(a, b);
+  }
+  a = levelAncestor(a, m_depth[b]);
+  if (a == b) {
+    return a;
+  }
+  for (int k = m_up.size() - 1; k >= 0; k--) {
+    if (m_up[k][a] != m_up[k][b]) {
+      a = m_up[k][a];
+      b = m_up[k][b];
+    }
+  }
+  return m_up[0][a];
+}
+
+int FamilyAncestryIndex::levelAncestor(int index, int depth) const {
+  Q_ASSERT(depth >= 0 && depth <= m_depth[index]);
+  int diff = m_depth[index] - depth;
+  for (int k = 0; diff > 0; k++, diff >>= 1) {
+    if (diff & 1) {
+      index = m_up[k][index];
+    }
+  }
+  return index;
+}
+
+MemberId FamilyAncestryIndex::lowestCommonAncestor(const MemberId& a, const MemberId& b) const {
+  int indexA = indexOf(a);
+  int indexB = indexOf(b);
+  if (indexA == -1 || indexB == -1) {
+    return MemberId();
+  }
+  return m_ids[lowestCommonAncestor(indexA, indexB)];
+}
+
+int FamilyAncestryIndex::generationDistance(const MemberId& a, const MemberId& b) const {
+  int indexA = indexOf(a);
+  int indexB = indexOf(b);
+  if (indexA == -1 || indexB == -1) {
+    return 0;
+  }
+  return m_depth[indexB] - m_depth[indexA];
+}
+
+int FamilyAncestryIndex::append(int parent, const MemberId& id) {
+  int index = m_ids.size();
+  m_ids.push_back(id);
+  m_idToIndex[id] = index;
+  m_depth.push_back(parent == -1 ? 0 : m_depth[parent] + 1);
+  if (m_up.empty()) {
+    m_up.emplace_back();
+  }
+  m_up[0].push_back(parent == -1 ? index : parent);
+  for (size_t k = 1; k < m_up.size(); k++) {
+    m_up[k].push_back(m_up[k - 1][m_up[k - 1][index]]);
+  }
+  if ((1 << m_up.size()) <= m_depth[index]) {
+    addLevel();
+  }
+  return index;
+}
+
+void FamilyAncestryIndex::addLevel() {
+  const std::vector<int>& prev = m_up.back();
+  std::vector<int> level(prev.size());
+  for (size_t v = 0; v < prev.size(); v++) {
+    level[v] = prev[prev[v]];
+  }
+  m_up.push_back(std::move(level));
+}
@@ -0,0 +1,64 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "familymember.h"
+
+// Binary lifting over the parent links. Rebuilt in linear time, a new leaf is patched in with O(log n) work, and
+// lowest common ancestor / level ancestor queries take O(log depth) array lookups.
+class FamilyAncestryIndex {
+ public:
+  void clear();
+  void build(const MemberId& rootId, const std::map<MemberId, FamilyMember>& members);
+  void addLeaf(const MemberId& parentId, const MemberId& id);
+
+  int indexOf(const MemberId& id) const;
+  MemberId idAt(int index) const { return m_ids[index]; }
+  int size() const { return m_ids.size(); }
+  size_t memoryUsage() const;
+
+  int depth(int index) const { return m_depth[index]; }
+  int lowestCommonAncestor(int a, int b) const;
+  int levelAncestor(int index, int depth) const;
+
+  MemberId lowestCommonAncestor(const MemberId& a, const MemberId& b) const;
+  int generationDistance(const MemberId& a, const MemberId& b) const;
+
+ private:
+  int append(int parent, const MemberId& id);
+  void addLevel();
+
+ private:
+  std::vector<MemberId> m_ids;
+  std::unordered_map<MemberId, int, MemberIdHash> m_idToIndex;
+  std::vector<int> m_depth;
+  // m_up[k][v] is the 2^k-th ancestor of v, the root is its own ancestor.
+  std::vector<std::vector<int>> m_up;
+};
@@ -0,0 +1,266 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familyautosave.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QStandardPaths>
+#include <QUuid>
+#include <QtConcurrent>
+
+#include "family.h"
+#include "trace.h"
+
+static const int kAutosaveIntervalMs = 30 * 1000;
+static const char* kJournalSuffix = ".jsonl";
+static const char* kLockSuffix = ".lock";
+
+// A lock never goes stale by age, only when the process that holds it is gone.
+static std::unique_ptr<QLockFile> tryLockJournal(const QString& journalPath) {
+  std::unique_ptr<QLockFile> result(new QLockFile(journalPath + kLockSuffix));
+  result->setStaleLockTime(0);
+  if (!result->tryLock(0)) {
+    return nullptr;
+  }
+  return result;
+}
+
+// Runs on a worker thread, both snapshots are immutable.
+static bool writeCheckpoint(const QString& path, bool isNew, const QString& sourcePath,
+                            std::shared_ptr<const FamilySnapshot> from, std::shared_ptr<const FamilySnapshot> to) {
+  TRACE_SCOPE("FamilyAutosave::write");
+  std::vector<const FamilyMember*> changed;
+  std::vector<MemberId> removed;
+  FamilySnapshot::diff(from.get(), *to, changed, removed);
+
+  QJsonObject record;
+  record["rootId"] = memberIdToString(to->rootId());
+  record["title"] = to->title();
+  QJsonArray members;
+  for (const FamilyMember* member : changed) {
+    if (member->noteOffset == -1) {
+      members.push_back(member->toJson());
+      continue;
+    }
+    // The journal has to stand on its own, out of line bodies are written inline.
+    FamilyMember inlined = *member;
+    inlined.note = to->fullNote(member->id);
+    inlined.noteOffset = -1;
+    inlined.noteSize = 0;
+    members.push_back(inlined.toJson());
+  }
+  record["members"] = members;
+  QJsonArray removedIds;
+  for (const MemberId& id : removed) {
+    removedIds.push_back(memberIdToString(id));
+  }
+  record["removed"] = removedIds;
+
+  QFile file(path);
+  if (!file.open(QFile::WriteOnly | (isNew ? QFile::Truncate : QFile::Append))) {
+    qDebug() << "can't open" << path;
+    return false;
+  }
+  if (isNew) {
+    QJsonObject header;
+    header["source"] = sourcePath;
+    file.write(QJsonDocument(header).toJson(QJsonDocument::Compact) + "\n");
+  }
+  file.write(QJsonDocument(record).toJson(QJsonDocument::Compact) + "\n");
+  return file.flush();
+}
+
+FamilyAutosave::FamilyAutosave(QObject* parent) : QObject(parent) {
+  m_timer.setInterval(kAutosaveIntervalMs);
+  connect(&m_timer, &QTimer::timeout, this, &FamilyAutosave::checkpoint);
+  connect(&m_watcher, &QFutureWatcher<bool>::finished, this, &FamilyAutosave::onWritten);
+  QDir().mkpath(journalDir());
+  m_journalPath = journalDir() + "/" + QUuid::createUuid().toString(QUuid::WithoutBraces) + kJournalSuffix;
+  m_lock = tryLockJournal(m_journalPath);
+  Q_ASSERT(m_lock);
+}
+
+FamilyAutosave::~FamilyAutosave() { waitForWrite(); }
+
+void FamilyAutosave::setFamily(Family* family, const QString& sourcePath) {
+  waitForWrite();
+  m_family = family;
+  m_sourcePath = sourcePath;
+  // An untitled family has no file to replay onto, its journal starts from scratch.
+  m_baseline = sourcePath == "" ? nullptr : family->snapshot();
+  m_checkpoint = m_baseline;
+  m_hasJournal = false;
+  // Records written before this point would be replayed onto the new source file and revert what was just saved.
+  if (!m_isAdopted) {
+    QFile::remove(m_journalPath);
+  }
+}
+
+void FamilyAutosave::continueRecovered() {
+  m_isAdopted = false;
+  m_baseline = nullptr;
+  m_checkpoint = m_family->snapshot();
+  m_hasJournal = true;
+}
+
+void FamilyAutosave::start() { m_timer.start(); }
+
+void FamilyAutosave::discard() {
+  m_timer.stop();
+  waitForWrite();
+  QFile::remove(m_journalPath);
+  m_hasJournal = false;
+  m_isAdopted = false;
+}
+
+bool FamilyAutosave::adoptOrphan() {
+  QDir dir(journalDir());
+  for (const QString& name : dir.entryList({QString("*") + kJournalSuffix}, QDir::Files, QDir::Time)) {
+    QString path = dir.filePath(name);
+    if (path == m_journalPath) {
+      continue;
+    }
+    std::unique_ptr<QLockFile> lock = tryLockJournal(path);
+    if (!lock) {
+      continue;
+    }
+    // Ours has not been written yet, the adopted one takes its place.
+    m_lock = std::move(lock);
+    m_journalPath = path;
+    m_isAdopted = true;
+    return true;
+  }
+  return false;
+}
+
+Family* FamilyAutosave::restore(QString* sourcePath) const {
+  TRACE_SCOPE("FamilyAutosave::restore");
+  QFile file(m_journalPath);
+  if (!file.open(QFile::ReadOnly)) {
+    return nullptr;
+  }
+  QJsonObject header = QJsonDocument::fromJson(file.readLine()).object();
+  *sourcePath = header["source"].toString();
+  std::unique_ptr<Family> source;
+  if (*sourcePath != "") {
+    source.reset(Family::load(*sourcePath));
+    if (!source) {
+      qDebug() << "can't load" << *sourcePath;
+      return nullptr;
+    }
+  }
+
+  std::map<MemberId, FamilyMember> members = source ? source->members() : std::map<MemberId, FamilyMember>();
+  QString title = source ? source->title() : "";
+  MemberId rootId = source ? source->rootId() : MemberId();
+  int recordCount = 0;
+  while (!file.atEnd()) {
+    // The last line may be cut short by the crash, everything before it is complete.
+    QJsonDocument d = QJsonDocument::fromJson(file.readLine());
+    if (!d.isObject()) {
+      break;
+    }
+    QJsonObject record = d.object();
+    rootId = memberIdFromString(record["rootId"].toString());
+    title = record["title"].toString();
+    for (const QJsonValue& mv : record["members"].toArray()) {
+      FamilyMember member = FamilyMember::fromJson(mv.toObject());
+      if (member.isValid()) {
+        members[member.id] = member;
+      }
+    }
+    for (const QJsonValue& iv : record["removed"].toArray()) {
+      members.erase(memberIdFromString(iv.toString()));
+    }
+    recordCount++;
+  }
+  qDebug() << "replayed" << recordCount << "checkpoint(s) onto" << *sourcePath;
+  if (!members.count(rootId)) {
+    return nullptr;
+  }
+
+  if (source && source->rootId() == rootId) {
+    source->replaceMembers(title, members);
+    return source.release();
+  }
+  QJsonObject o;
+  o["rootId"] = memberIdToString(rootId);
+  o["title"] = title;
+  QJsonArray a;
+  for (const auto& pair : members) {
+    a.push_back(pair.second.toJson());
+  }
+  o["members"] = a;
+  Family* result = Family::fromJson(QJsonDocument(o).toJson(QJsonDocument::Compact));
+  if (result) {
+    result->setIsDirty(true);
+  }
+  return result;
+}
+
+void FamilyAutosave::checkpoint() {
+  if (m_family == nullptr || m_watcher.isRunning()) {
+    return;
+  }
+  if (!m_family->isDirty()) {
+    // Back to what is on disk, the journal has nothing to add.
+    if (m_hasJournal) {
+      QFile::remove(m_journalPath);
+      m_hasJournal = false;
+      m_checkpoint = m_baseline;
+    }
+    return;
+  }
+  std::shared_ptr<const FamilySnapshot> snapshot = m_family->snapshot();
+  if (m_hasJournal && m_checkpoint && snapshot->contentHash() == m_checkpoint->contentHash()) {
+    return;
+  }
+  m_writing = snapshot;
+  std::shared_ptr<const FamilySnapshot> base = m_hasJournal ? m_checkpoint : m_baseline;
+  m_watcher.setFuture(QtConcurrent::run(writeCheckpoint, m_journalPath, !m_hasJournal, m_sourcePath, base, snapshot));
+}
+
+void FamilyAutosave::onWritten() {
+  if (m_writing == nullptr) {
+    return;
+  }
+  if (m_watcher.result()) {
+    m_checkpoint = m_writing;
+    m_hasJournal = true;
+  }
+  m_writing = nullptr;
+}
+
+void FamilyAutosave::waitForWrite() {
+  m_watcher.waitForFinished();
+  onWritten();
+}
+
+QString FamilyAutosave::journalDir() {
+  return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/recovery";
+}
@@ -0,0 +1,86 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QFutureWatcher>
+#include <QLockFile>
+#include <QObject>
+#include <QTimer>
+#include <memory>
+
+#include "familysnapshot.h"
+
+class Family;
+
+// Periodic crash recovery journal. Each checkpoint takes a snapshot on the GUI thread, then a worker thread diffs it
+// against the previous checkpoint and appends only the changed members as one line to the journal. The journal
+// starts at the file the family was loaded from or last saved to, and is removed on save or clean exit.
+//
+// Each instance writes its own journal and holds a lock on it while running, so only journals whose owner is gone are
+// offered for recovery.
+class FamilyAutosave : public QObject {
+  Q_OBJECT
+
+ public:
+  explicit FamilyAutosave(QObject* parent = nullptr);
+  ~FamilyAutosave();
+
+  // A new baseline, after a load or a save to sourcePath.
+  void setFamily(Family* family, const QString& sourcePath);
+  // The family came from restore(), keep adding to the journal it was restored from.
+  void continueRecovered();
+  // Takes over the journal of an instance that did not exit normally, if there is one.
+  bool adoptOrphan();
+  // Replays the adopted journal on top of its source file, sourcePath receives the file it started from.
+  Family* restore(QString* sourcePath) const;
+  void start();
+  // Writes a checkpoint now instead of at the next tick, the write itself still runs on a worker thread.
+  void checkpoint();
+  // Normal exit, nothing to recover.
+  void discard();
+  // Call before the source file is rewritten, a checkpoint in flight may still read out of line notes from it.
+  void waitForWrite();
+
+
+ private:
+  void onWritten();
+  static QString journalDir();
+
+ private:
+  QTimer m_timer;
+  Family* m_family = nullptr;
+  QString m_sourcePath;
+  // State of the source file, null when it is unknown and a new journal must hold every member.
+  std::shared_ptr<const FamilySnapshot> m_baseline;
+  // State the journal has reached.
+  std::shared_ptr<const FamilySnapshot> m_checkpoint;
+  std::shared_ptr<const FamilySnapshot> m_writing;
+  bool m_hasJournal = false;
+  // The adopted journal is kept until continueRecovered() or discard() decides what becomes of it.
+  bool m_isAdopted = false;
+  QFutureWatcher<bool> m_watcher;
+  QString m_journalPath;
+  std::unique_ptr<QLockFile> m_lock;
+};
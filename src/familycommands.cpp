@@ -0,0 +1,178 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familycommands.h"
+
+#include "family.h"
+#include "familydiff.h"
+
+// Out of line offsets point into the current file, which the next save rewrites.
+static FamilyMember inlineNote(const Family& family, FamilyMember member) {
+  if (member.noteOffset != -1) {
+    member.note = family.fullNote(member.id);
+    member.noteOffset = -1;
+    member.noteSize = 0;
+  }
+  member.clearLayoutValue();
+  return member;
+}
+
+AddChildCommand::AddChildCommand(Family* family, const MemberId& parentId, const FamilyMember& child)
+    : m_family(family), m_parentId(parentId), m_child(child) {
+  setText(QObject::tr("Add %1").arg(child.name));
+}
+
+void AddChildCommand::redo() { m_family->addChild(m_parentId, m_child); }
+
+void AddChildCommand::undo() { m_family->removeSubtree(m_child.id); }
+
+UpdateMemberCommand::UpdateMemberCommand(Family* family, const FamilyMember& member)
+    : m_family(family), m_member(member) {
+  m_oldMember = m_family->getMember(member.id);
+  // The body is kept inline, a later save moves out of line notes to other offsets.
+  m_oldMember.note = m_family->fullNote(member.id);
+  m_oldMember.noteOffset = -1;
+  m_oldMember.noteSize = 0;
+  setText(QObject::tr("Edit %1").arg(member.name));
+}
+
+void UpdateMemberCommand::redo() { apply(m_member); }
+
+void UpdateMemberCommand::undo() { apply(m_oldMember); }
+
+void UpdateMemberCommand::apply(const FamilyMember& data) {
+  FamilyMember member = m_family->getMember(data.id);
+  member.title = data.title;
+  member.name = data.name;
+  member.spouseName = data.spouseName;
+  member.isMale = data.isMale;
+  member.isAlive = data.isAlive;
+  member.isSpouseAlive = data.isSpouseAlive;
+  member.note = data.note;
+  member.noteOffset = data.noteOffset;
+  member.noteSize = data.noteSize;
+  member.noteHash = data.noteHash;
+  member.portrait = data.portrait;
+  m_family->updateMember(member);
+}
+
+ReorderChildrenCommand::ReorderChildrenCommand(Family* family, const MemberId& parentId,
+                                               const std::vector<MemberId>& children)
+    : m_family(family), m_parentId(parentId), m_children(children) {
+  m_oldChildren = m_family->getMember(parentId).children;
+  setText(QObject::tr("Reorder children"));
+}
+
+void ReorderChildrenCommand::redo() { m_family->reorderChildren(m_parentId, m_children); }
+
+void ReorderChildrenCommand::undo() { m_family->reorderChildren(m_parentId, m_oldChildren); }
+
+UpdateTitleCommand::UpdateTitleCommand(Family* family, const QString& title)
+    : m_family(family), m_title(title), m_oldTitle(family->title()) {
+  setText(QObject::tr("Edit title"));
+}
+
+void UpdateTitleCommand::redo() { m_family->updateTitle(m_title); }
+
+void UpdateTitleCommand::undo() { m_family->updateTitle(m_oldTitle); }
+
+InsertSubtreeCommand::InsertSubtreeCommand(Family* family, const MemberId& parentId,
+                                           const std::vector<FamilyMember>& members)
+    : m_family(family), m_parentId(parentId), m_members(members) {
+  Q_ASSERT(!m_members.empty());
+  m_index = m_family->getMember(parentId).children.size();
+  setText(QObject::tr("Paste %1 member(s)").arg(m_members.size()));
+}
+
+void InsertSubtreeCommand::redo() { m_family->insertSubtree(m_parentId, m_index, m_members); }
+
+void InsertSubtreeCommand::undo() { m_family->removeSubtree(m_members.front().id); }
+
+RemoveSubtreeCommand::RemoveSubtreeCommand(Family* family, const MemberId& id) : m_family(family), m_id(id) {
+  FamilyMember member = m_family->getMember(id);
+  m_parentId = member.parentId;
+  m_index = member.indexAsChild;
+  setText(QObject::tr("Delete %1").arg(member.name));
+}
+
+void RemoveSubtreeCommand::redo() { m_members = m_family->removeSubtree(m_id); }
+
+void RemoveSubtreeCommand::undo() {
+  m_family->insertSubtree(m_parentId, m_index, m_members);
+  m_members.clear();
+}
+
+ReplaceMembersCommand::ReplaceMembersCommand(Family* family, const QString& title,
+                                             const std::map<MemberId, FamilyMember>& members, const QString& text)
+    : m_family(family) {
+  const std::map<MemberId, FamilyMember>& current = m_family->members();
+  m_patch.title = title;
+  m_oldPatch.title = m_family->title();
+  for (const auto& pair : members) {
+    auto iter = current.find(pair.first);
+    if (iter == current.end()) {
+      m_patch.members.push_back(inlineNote(*m_family, pair.second));
+      m_oldPatch.removedIds.push_back(pair.first);
+    } else if (!FamilyDiff::isSameMember(iter->second, pair.second)) {
+      m_patch.members.push_back(inlineNote(*m_family, pair.second));
+      m_oldPatch.members.push_back(inlineNote(*m_family, iter->second));
+    }
+  }
+  for (const auto& pair : current) {
+    if (!members.count(pair.first)) {
+      m_patch.removedIds.push_back(pair.first);
+      m_oldPatch.members.push_back(inlineNote(*m_family, pair.second));
+    }
+  }
+  setText(text);
+}
+
+void ReplaceMembersCommand::redo() { apply(m_patch); }
+
+void ReplaceMembersCommand::undo() { apply(m_oldPatch); }
+
+void ReplaceMembersCommand::apply(const Patch& patch) {
+  std::map<MemberId, FamilyMember> members = m_family->members();
+  for (const MemberId& id : patch.removedIds) {
+    members.erase(id);
+  }
+  for (const FamilyMember& member : patch.members) {
+    members[member.id] = member;
+  }
+  m_family->replaceMembers(patch.title, members);
+}
+
+MoveSubtreeCommand::MoveSubtreeCommand(Family* family, const MemberId& id, const MemberId& newParentId)
+    : m_family(family), m_id(id), m_newParentId(newParentId) {
+  FamilyMember member = m_family->getMember(id);
+  m_oldParentId = member.parentId;
+  m_oldIndex = member.indexAsChild;
+  setText(QObject::tr("Move %1").arg(member.name));
+}
+
+void MoveSubtreeCommand::redo() {
+  m_family->moveSubtree(m_id, m_newParentId, m_family->getMember(m_newParentId).children.size());
+}
+
+void MoveSubtreeCommand::undo() { m_family->moveSubtree(m_id, m_oldParentId, m_oldIndex); }
@@ -0,0 +1,151 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <QUndoCommand>
+#include <map>
+#include <vector>
+
+#include "familymember.h"
+
+class Family;
+
+// Every edit of a family goes through one of these, so undo and redo always replay onto the state they were recorded
+// in. Each one is a single step on the undo stack.
+class AddChildCommand : public QUndoCommand {
+ public:
+  AddChildCommand(Family* family, const MemberId& parentId, const FamilyMember& child);
+  void redo() override;
+  void undo() override;
+
+ private:
+  Family* m_family = nullptr;
+  MemberId m_parentId;
+  FamilyMember m_child;
+};
+
+// Sets the data fields only, the links are left to the structure edits.
+class UpdateMemberCommand : public QUndoCommand {
+ public:
+  UpdateMemberCommand(Family* family, const FamilyMember& member);
+  void redo() override;
+  void undo() override;
+
+ private:
+  void apply(const FamilyMember& data);
+
+  Family* m_family = nullptr;
+  FamilyMember m_member;
+  FamilyMember m_oldMember;
+};
+
+class ReorderChildrenCommand : public QUndoCommand {
+ public:
+  ReorderChildrenCommand(Family* family, const MemberId& parentId, const std::vector<MemberId>& children);
+  void redo() override;
+  void undo() override;
+
+ private:
+  Family* m_family = nullptr;
+  MemberId m_parentId;
+  std::vector<MemberId> m_children;
+  std::vector<MemberId> m_oldChildren;
+};
+
+class UpdateTitleCommand : public QUndoCommand {
+ public:
+  UpdateTitleCommand(Family* family, const QString& title);
+  void redo() override;
+  void undo() override;
+
+ private:
+  Family* m_family = nullptr;
+  QString m_title;
+  QString m_oldTitle;
+};
+
+class InsertSubtreeCommand : public QUndoCommand {
+ public:
+  InsertSubtreeCommand(Family* family, const MemberId& parentId, const std::vector<FamilyMember>& members);
+  void redo() override;
+  void undo() override;
+
+ private:
+  Family* m_family = nullptr;
+  MemberId m_parentId;
+  int m_index = 0;
+  std::vector<FamilyMember> m_members;
+};
+
+class RemoveSubtreeCommand : public QUndoCommand {
+ public:
+  RemoveSubtreeCommand(Family* family, const MemberId& id);
+  void redo() override;
+  void undo() override;
+
+ private:
+  Family* m_family = nullptr;
+  MemberId m_id;
+  MemberId m_parentId;
+  int m_index = 0;
+  std::vector<FamilyMember> m_members;
+};
+
+// Applies a merged member set as a single step, undo puts the previous members back as they were. Only the members
+// that differ are kept, with their notes inline.
+class ReplaceMembersCommand : public QUndoCommand {
+ public:
+  ReplaceMembersCommand(Family* family, const QString& title, const std::map<MemberId, FamilyMember>& members,
+                        const QString& text);
+  void redo() override;
+  void undo() override;
+
+ private:
+  struct Patch {
+    QString title;
+    std::vector<FamilyMember> members;
+    std::vector<MemberId> removedIds;
+  };
+  void apply(const Patch& patch);
+
+  Family* m_family = nullptr;
+  Patch m_patch;
+  Patch m_oldPatch;
+};
+
+class MoveSubtreeCommand : public QUndoCommand {
+ public:
+  MoveSubtreeCommand(Family* family, const MemberId& id, const MemberId& newParentId);
+  void redo() override;
+  void undo() override;
+
+ private:
+  Family* m_family = nullptr;
+  MemberId m_id;
+  MemberId m_oldParentId;
+  int m_oldIndex = 0;
+  MemberId m_newParentId;
+};
@@ -0,0 +1,556 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familydiff.h"
+
+#include <QStringList>
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "family.h"
+#include "trace.h"
+
+using MemberMap = std::map<MemberId, FamilyMember>;
+
+static QString noteText(const Family& family, const FamilyMember& member) {
+  return member.noteOffset == -1 ? member.note : family.fullNote(member.id);
+}
+
+// Out of line notes are read only when the previews and sizes can't tell them apart.
+static bool isSameNote(const Family& familyA, const FamilyMember& a, const Family& familyB, const FamilyMember& b) {
+  bool isInlineA = a.noteOffset == -1;
+  bool isInlineB = b.noteOffset == -1;
+  if (isInlineA && isInlineB) {
+    return a.note == b.note;
+  }
+  if (!isInlineA && !isInlineB && (a.note != b.note || a.noteSize != b.noteSize)) {
+    return false;
+  }
+  return noteText(familyA, a) == noteText(familyB, b);
+}
+
+static unsigned dataChanges(const Family& familyA, const FamilyMember& a, const Family& familyB,
+                            const FamilyMember& b) {
+  unsigned result = FamilyDiff::changedFields(a, b) & ~FamilyDiff::kNote;
+  if (!isSameNote(familyA, a, familyB, b)) {
+    result |= FamilyDiff::kNote;
+  }
+  return result;
+}
+
+static QString fieldNames(unsigned fields) {
+  static const char* kNames[] = {"title", "name",         "spouse name", "gender",
+                                 "alive", "spouse alive", "note",        "portrait"};
+  QStringList result;
+  for (size_t i = 0; i < std::size(kNames); i++) {
+    if (fields & (1u << i)) {
+      result.push_back(kNames[i]);
+    }
+  }
+  return result.join(", ");
+}
+
+// Children present in both lists, in a different relative order.
+static bool isReordered(const std::vector<MemberId>& a, const std::vector<MemberId>& b) {
+  if (a == b) {
+    return false;
+  }
+  std::unordered_set<MemberId, MemberIdHash> inA(a.begin(), a.end());
+  std::unordered_set<MemberId, MemberIdHash> inB(b.begin(), b.end());
+  std::vector<MemberId> commonA;
+  std::vector<MemberId> commonB;
+  std::copy_if(a.begin(), a.end(), std::back_inserter(commonA), [&inB](const MemberId& id) { return inB.count(id); });
+  std::copy_if(b.begin(), b.end(), std::back_inserter(commonB), [&inA](const MemberId& id) { return inA.count(id); });
+  return commonA != commonB;
+}
+
+static std::vector<FamilyDiff::Change> diffMembers(const Family& fromFamily, const MemberMap& from,
+                                                   const Family& toFamily, const MemberMap& to) {
+  std::vector<FamilyDiff::Change> result;
+  auto i = from.begin();
+  auto j = to.begin();
+  while (i != from.end() || j != to.end()) {
+    FamilyDiff::Change change;
+    if (j == to.end() || (i != from.end() && i->first < j->first)) {
+      change.id = (i++)->first;
+      change.kind = FamilyDiff::Change::Removed;
+      result.push_back(change);
+      continue;
+    }
+    if (i == from.end() || j->first < i->first) {
+      change.id = (j++)->first;
+      change.kind = FamilyDiff::Change::Added;
+      result.push_back(change);
+      continue;
+    }
+    const FamilyMember& a = (i++)->second;
+    const FamilyMember& b = (j++)->second;
+    change.id = a.id;
+    change.fields = dataChanges(fromFamily, a, toFamily, b);
+    change.isMoved = a.parentId != b.parentId;
+    change.isReordered = isReordered(a.children, b.children);
+    if (change.fields != 0 || change.isMoved || change.isReordered) {
+      result.push_back(change);
+    }
+  }
+  return result;
+}
+
+// Breadth-first from the root, children are only visited when visit returns true.
+template <typename Visit>
+static void walk(const MemberMap& members, const MemberId& rootId, Visit visit) {
+  std::vector<MemberId> queue({rootId});
+  for (size_t i = 0; i < queue.size(); i++) {
+    auto iter = members.find(queue[i]);
+    if (iter == members.end() || !visit(iter->second)) {
+      continue;
+    }
+    queue.insert(queue.end(), iter->second.children.begin(), iter->second.children.end());
+  }
+}
+
+std::vector<FamilyDiff::Change> FamilyDiff::diff(const Family& from, const Family& to) {
+  TRACE_SCOPE("FamilyDiff::diff");
+  const MemberMap& fromMembers = from.members();
+  const MemberMap& toMembers = to.members();
+  std::vector<Change> result;
+  // A branch with the same subtree hash on both sides holds the same members with the same fields, neither walk
+  // descends into it.
+  walk(toMembers, to.rootId(), [&](const FamilyMember& member) {
+    Change change;
+    change.id = member.id;
+    auto iter = fromMembers.find(member.id);
+    if (iter == fromMembers.end()) {
+      change.kind = Change::Added;
+      result.push_back(change);
+      return true;
+    }
+    const FamilyMember& old = iter->second;
+    bool isSame = old._subTreeHash == member._subTreeHash;
+    if (!isSame) {
+      change.fields = dataChanges(from, old, to, member);
+      change.isReordered = isReordered(old.children, member.children);
+    }
+    change.isMoved = old.parentId != member.parentId;
+    if (change.fields != 0 || change.isMoved || change.isReordered) {
+      result.push_back(change);
+    }
+    return !isSame;
+  });
+  walk(fromMembers, from.rootId(), [&](const FamilyMember& member) {
+    auto iter = toMembers.find(member.id);
+    if (iter == toMembers.end()) {
+      Change change;
+      change.id = member.id;
+      change.kind = Change::Removed;
+      result.push_back(change);
+      return true;
+    }
+    return iter->second._subTreeHash != member._subTreeHash;
+  });
+  return result;
+}
+
+unsigned FamilyDiff::changedFields(const FamilyMember& a, const FamilyMember& b) {
+  unsigned result = 0;
+  result |= a.title != b.title ? kTitle : 0;
+  result |= a.name != b.name ? kName : 0;
+  result |= a.spouseName != b.spouseName ? kSpouseName : 0;
+  result |= a.isMale != b.isMale ? kIsMale : 0;
+  result |= a.isAlive != b.isAlive ? kIsAlive : 0;
+  result |= a.isSpouseAlive != b.isSpouseAlive ? kIsSpouseAlive : 0;
+  result |= a.note != b.note ? kNote : 0;
+  result |= a.portrait != b.portrait ? kPortrait : 0;
+  return result;
+}
+
+bool FamilyDiff::isSameMember(const FamilyMember& a, const FamilyMember& b) {
+  return changedFields(a, b) == 0 && a.noteOffset == b.noteOffset && a.noteSize == b.noteSize &&
+         a.noteHash == b.noteHash && a.parentId == b.parentId && a.indexAsChild == b.indexAsChild &&
+         a.children == b.children;
+}
+
+class FamilyMerger {
+ public:
+  FamilyMerger(const Family& base, const Family& ours, const Family& theirs)
+      : m_base(base), m_ours(ours), m_theirs(theirs) {}
+
+  FamilyDiff::Merge run();
+
+ private:
+  struct Slot {
+    MemberId id;
+    const FamilyMember* base = nullptr;
+    const FamilyMember* ours = nullptr;
+    const FamilyMember* theirs = nullptr;
+    FamilyMember merged;
+    int parent = -1;
+    bool isKept = false;
+    bool isPlaced = false;
+  };
+
+  void collect();
+  void mergeData(int index);
+  void takeTheirs(Slot& slot, unsigned fields);
+  void chooseParent(int index);
+  void keepAncestors();
+  void breakCycles();
+  void buildChildren();
+  bool isModified(const Family& family, const FamilyMember& member, const FamilyMember& base) const;
+  int slotOf(const MemberId& id) const;
+  void addConflict(int index, const QString& message);
+
+ private:
+  const Family& m_base;
+  const Family& m_ours;
+  const Family& m_theirs;
+  std::vector<Slot> m_slots;
+  std::unordered_map<MemberId, int, MemberIdHash> m_idToSlot;
+  int m_rootSlot = -1;
+  FamilyDiff::Merge m_result;
+};
+
+FamilyDiff::Merge FamilyMerger::run() {
+  collect();
+  m_rootSlot = slotOf(m_ours.rootId());
+  Q_ASSERT(m_rootSlot != -1);
+  if (m_rootSlot == -1) {
+    return m_result;
+  }
+  if (m_base.rootId() != m_ours.rootId() || m_theirs.rootId() != m_ours.rootId()) {
+    addConflict(m_rootSlot, "the copies have different roots, kept the root of ours");
+  }
+  for (size_t i = 0; i < m_slots.size(); i++) {
+    mergeData(i);
+    chooseParent(i);
+  }
+  Slot& root = m_slots[m_rootSlot];
+  if (!root.isKept) {
+    root.merged = *root.ours;
+    root.isKept = true;
+  }
+  root.parent = -1;
+  keepAncestors();
+  breakCycles();
+  buildChildren();
+
+  const QString& baseTitle = m_base.title();
+  m_result.title = m_ours.title() == baseTitle ? m_theirs.title() : m_ours.title();
+  if (m_ours.title() != baseTitle && m_theirs.title() != baseTitle && m_ours.title() != m_theirs.title()) {
+    addConflict(m_rootSlot, "family title changed in both copies, kept ours");
+  }
+  for (Slot& slot : m_slots) {
+    if (slot.isKept) {
+      slot.merged.clearLayoutValue();
+      m_result.members.emplace_hint(m_result.members.end(), slot.id, std::move(slot.merged));
+    }
+  }
+  m_result.changes = diffMembers(m_ours, m_ours.members(), m_ours, m_result.members);
+  return std::move(m_result);
+}
+
+void FamilyMerger::collect() {
+  const MemberMap& base = m_base.members();
+  const MemberMap& ours = m_ours.members();
+  const MemberMap& theirs = m_theirs.members();
+  m_slots.reserve(std::max({base.size(), ours.size(), theirs.size()}));
+  m_idToSlot.reserve(m_slots.capacity());
+  auto baseIter = base.begin();
+  auto oursIter = ours.begin();
+  auto theirsIter = theirs.begin();
+  while (baseIter != base.end() || oursIter != ours.end() || theirsIter != theirs.end()) {
+    MemberId id;
+    bool hasId = false;
+    auto consider = [&id, &hasId](MemberMap::const_iterator iter, const MemberMap& map) {
+      if (iter != map.end() && (!hasId || iter->first < id)) {
+        id = iter->first;
+        hasId = true;
+      }
+    };
+    consider(baseIter, base);
+    consider(oursIter, ours);
+    consider(theirsIter, theirs);
+    auto take = [&id](MemberMap::const_iterator& iter, const MemberMap& map) -> const FamilyMember* {
+      if (iter == map.end() || iter->first != id) {
+        return nullptr;
+      }
+      return &(iter++)->second;
+    };
+    Slot slot;
+    slot.id = id;
+    slot.base = take(baseIter, base);
+    slot.ours = take(oursIter, ours);
+    slot.theirs = take(theirsIter, theirs);
+    m_idToSlot[id] = m_slots.size();
+    m_slots.push_back(slot);
+  }
+}
+
+// Field by field, a side that left a field as it was in base takes the value of the other side.
+void FamilyMerger::mergeData(int index) {
+  Slot& slot = m_slots[index];
+  const FamilyMember* base = slot.base;
+  const FamilyMember* ours = slot.ours;
+  const FamilyMember* theirs = slot.theirs;
+  if (ours && theirs) {
+    slot.merged = *ours;
+    slot.isKept = true;
+    unsigned conflicting = 0;
+    if (base) {
+      unsigned oursChanged = dataChanges(m_base, *base, m_ours, *ours);
+      unsigned theirsChanged = dataChanges(m_base, *base, m_theirs, *theirs);
+      takeTheirs(slot, theirsChanged & ~oursChanged);
+      if (oursChanged & theirsChanged) {
+        conflicting = oursChanged & theirsChanged & dataChanges(m_ours, *ours, m_theirs, *theirs);
+      }
+    } else {
+      conflicting = dataChanges(m_ours, *ours, m_theirs, *theirs);
+    }
+    if (conflicting) {
+      addConflict(index, QString("%1 changed in both copies, kept ours").arg(fieldNames(conflicting)));
+    }
+    return;
+  }
+  if (ours) {
+    slot.merged = *ours;
+    slot.isKept = base == nullptr || isModified(m_ours, *ours, *base);
+    if (base && slot.isKept) {
+      addConflict(index, "removed in theirs but edited in ours, kept");
+    }
+    return;
+  }
+  if (theirs) {
+    slot.merged = *theirs;
+    takeTheirs(slot, FamilyDiff::kNote);
+    slot.isKept = base == nullptr || isModified(m_theirs, *theirs, *base);
+    if (base && slot.isKept) {
+      addConflict(index, "removed in ours but edited in theirs, kept");
+    }
+  }
+}
+
+void FamilyMerger::takeTheirs(Slot& slot, unsigned fields) {
+  const FamilyMember& theirs = *slot.theirs;
+  FamilyMember& merged = slot.merged;
+  if (fields & FamilyDiff::kTitle) {
+    merged.title = theirs.title;
+  }
+  if (fields & FamilyDiff::kName) {
+    merged.name = theirs.name;
+  }
+  if (fields & FamilyDiff::kSpouseName) {
+    merged.spouseName = theirs.spouseName;
+  }
+  if (fields & FamilyDiff::kIsMale) {
+    merged.isMale = theirs.isMale;
+  }
+  if (fields & FamilyDiff::kIsAlive) {
+    merged.isAlive = theirs.isAlive;
+  }
+  if (fields & FamilyDiff::kIsSpouseAlive) {
+    merged.isSpouseAlive = theirs.isSpouseAlive;
+  }
+  // Offsets point into the note store of theirs, so the body comes along in full.
+  if (fields & FamilyDiff::kNote) {
+    merged.note = noteText(m_theirs, theirs);
+    merged.noteOffset = -1;
+    merged.noteSize = 0;
+  }
+  if (fields & FamilyDiff::kPortrait) {
+    merged.portrait = theirs.portrait;
+  }
+}
+
+void FamilyMerger::chooseParent(int index) {
+  Slot& slot = m_slots[index];
+  const FamilyMember* base = slot.base;
+  const FamilyMember* ours = slot.ours;
+  const FamilyMember* theirs = slot.theirs;
+  MemberId parentId;
+  if (base && ours && theirs) {
+    if (ours->parentId == base->parentId) {
+      parentId = theirs->parentId;
+    } else {
+      parentId = ours->parentId;
+      if (theirs->parentId != base->parentId && theirs->parentId != ours->parentId) {
+        addConflict(index, "moved to different parents in both copies, kept ours");
+      }
+    }
+  } else if (ours) {
+    parentId = ours->parentId;
+  } else if (theirs) {
+    parentId = theirs->parentId;
+  } else {
+    parentId = base->parentId;
+  }
+  slot.parent = parentId.isNull() ? -1 : slotOf(parentId);
+}
+
+// A member kept because of a child added or moved under it on one side, while the other side removed it.
+void FamilyMerger::keepAncestors() {
+  for (size_t i = 0; i < m_slots.size(); i++) {
+    int child = i;
+    while (m_slots[child].isKept && child != m_rootSlot) {
+      int parent = m_slots[child].parent;
+      if (parent == -1) {
+        addConflict(child, "parent not found in any copy, moved under the root");
+        m_slots[child].parent = m_rootSlot;
+        break;
+      }
+      Slot& slot = m_slots[parent];
+      if (slot.isKept) {
+        break;
+      }
+      if (slot.ours) {
+        slot.merged = *slot.ours;
+      } else {
+        Q_ASSERT(slot.theirs);
+        slot.merged = *slot.theirs;
+        takeTheirs(slot, FamilyDiff::kNote);
+      }
+      slot.isKept = true;
+      addConflict(parent, "removed in one copy but still has children in the other, kept");
+      child = parent;
+    }
+  }
+}
+
+// Moves on both sides, e.g. A under B in ours and B under A in theirs, can close a loop. The first pass puts a member
+// of each loop back under its parent in ours, anything still looping after that goes under the root.
+void FamilyMerger::breakCycles() {
+  for (int round = 0;; round++) {
+    // 0 not visited, 1 on the current path, 2 done.
+    std::vector<char> states(m_slots.size(), 0);
+    std::vector<int> path;
+    bool hasCycle = false;
+    for (size_t i = 0; i < m_slots.size(); i++) {
+      if (!m_slots[i].isKept || states[i] != 0) {
+        continue;
+      }
+      path.clear();
+      int index = i;
+      while (index != -1 && states[index] == 0) {
+        states[index] = 1;
+        path.push_back(index);
+        index = m_slots[index].parent;
+      }
+      if (index != -1 && states[index] == 1) {
+        hasCycle = true;
+        Slot& slot = m_slots[index];
+        int oursParent = slot.ours ? slotOf(slot.ours->parentId) : -1;
+        bool canRevert = round == 0 && oursParent != -1 && oursParent != slot.parent && m_slots[oursParent].isKept;
+        slot.parent = canRevert ? oursParent : m_rootSlot;
+        addConflict(index, canRevert ? "moves in both copies form a loop, kept the parent of ours"
+                                     : "moves in both copies form a loop, moved under the root");
+      }
+      for (int visited : path) {
+        states[visited] = 2;
+      }
+    }
+    if (!hasCycle) {
+      return;
+    }
+  }
+}
+
+// Children keep the order of the side that reordered them, children only the other side knows about follow in its
+// order, and members that ended up under a parent neither side had them under go last.
+void FamilyMerger::buildChildren() {
+  for (Slot& slot : m_slots) {
+    slot.merged.children.clear();
+  }
+  for (size_t i = 0; i < m_slots.size(); i++) {
+    Slot& slot = m_slots[i];
+    if (!slot.isKept) {
+      continue;
+    }
+    const FamilyMember* base = slot.base;
+    const FamilyMember* ours = slot.ours;
+    const FamilyMember* theirs = slot.theirs;
+    const std::vector<MemberId>* lists[2] = {nullptr, nullptr};
+    if (ours && theirs) {
+      bool isOursChanged = base == nullptr || ours->children != base->children;
+      lists[0] = isOursChanged ? &ours->children : &theirs->children;
+      lists[1] = isOursChanged ? &theirs->children : &ours->children;
+      if (base && isOursChanged && theirs->children != base->children &&
+          isReordered(ours->children, theirs->children)) {
+        addConflict(i, "children reordered in both copies, kept the order of ours");
+      }
+    } else {
+      lists[0] = ours ? &ours->children : theirs ? &theirs->children : &base->children;
+    }
+    for (const std::vector<MemberId>* list : lists) {
+      if (list == nullptr) {
+        continue;
+      }
+      for (const MemberId& childId : *list) {
+        int child = slotOf(childId);
+        if (child == -1 || !m_slots[child].isKept || m_slots[child].parent != static_cast<int>(i) ||
+            m_slots[child].isPlaced) {
+          continue;
+        }
+        slot.merged.children.push_back(childId);
+        m_slots[child].isPlaced = true;
+      }
+    }
+  }
+  for (Slot& slot : m_slots) {
+    if (slot.isKept && slot.parent != -1 && !slot.isPlaced) {
+      m_slots[slot.parent].merged.children.push_back(slot.id);
+      slot.isPlaced = true;
+    }
+  }
+  for (Slot& slot : m_slots) {
+    if (!slot.isKept) {
+      continue;
+    }
+    slot.merged.parentId = slot.parent == -1 ? MemberId() : m_slots[slot.parent].id;
+    const std::vector<MemberId>& children = slot.merged.children;
+    for (size_t i = 0; i < children.size(); i++) {
+      m_slots[slotOf(children[i])].merged.indexAsChild = i;
+    }
+  }
+  m_slots[m_rootSlot].merged.indexAsChild = 0;
+}
+
+bool FamilyMerger::isModified(const Family& family, const FamilyMember& member, const FamilyMember& base) const {
+  return member.parentId != base.parentId || member.children != base.children ||
+         dataChanges(m_base, base, family, member) != 0;
+}
+
+int FamilyMerger::slotOf(const MemberId& id) const {
+  auto iter = m_idToSlot.find(id);
+  return iter == m_idToSlot.end() ? -1 : iter->second;
+}
+
+void FamilyMerger::addConflict(int index, const QString& message) {
+  m_result.conflicts.push_back({m_slots[index].id, message});
+}
+
+FamilyDiff::Merge FamilyDiff::merge(const Family& base, const Family& ours, const Family& theirs) {
+  TRACE_SCOPE("FamilyDiff::merge");
+  return FamilyMerger(base, ours, theirs).run();
+}
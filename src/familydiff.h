@@ -0,0 +1,87 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <map>
+#include <vector>
+
+#include "familymember.h"
+
+class Family;
+
+// Structural diff and three-way merge keyed by member id. The diff walks both trees from the root and skips branches
+// whose subtree hashes match. The merge walks the id-ordered member maps side by side in one pass and puts the tree
+// back together with hash lookups, linear in the number of members.
+class FamilyDiff {
+ public:
+  enum Field : unsigned {
+    kTitle = 1 << 0,
+    kName = 1 << 1,
+    kSpouseName = 1 << 2,
+    kIsMale = 1 << 3,
+    kIsAlive = 1 << 4,
+    kIsSpouseAlive = 1 << 5,
+    kNote = 1 << 6,
+    kPortrait = 1 << 7,
+  };
+
+  struct Change {
+    enum Kind { Added, Removed, Modified };
+    MemberId id;
+    Kind kind = Modified;
+    // Changed data fields of a Modified member.
+    unsigned fields = 0;
+    bool isMoved = false;
+    // Same children in a different order.
+    bool isReordered = false;
+  };
+
+  struct Conflict {
+    MemberId id;
+    QString message;
+  };
+
+  struct Merge {
+    QString title;
+    std::map<MemberId, FamilyMember> members;
+    std::vector<Conflict> conflicts;
+    // From ours to the merged members.
+    std::vector<Change> changes;
+  };
+
+  // Members outside the tree of the root, e.g. orphans of an unrepaired file, are not compared.
+  static std::vector<Change> diff(const Family& from, const Family& to);
+
+  // Combines what ours and theirs changed since base, a conflict keeps ours and is reported. The result is meant for
+  // Family::replaceMembers on ours: members taken from theirs carry their notes in full, the rest still refer to the
+  // notes of ours.
+  static Merge merge(const Family& base, const Family& ours, const Family& theirs);
+
+  // Data fields that differ, out of line notes are compared by their previews only.
+  static unsigned changedFields(const FamilyMember& a, const FamilyMember& b);
+  // No changed fields, and the same note location and links.
+  static bool isSameMember(const FamilyMember& a, const FamilyMember& b);
+};
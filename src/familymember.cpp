@@ -26,45 +26,96 @@
 
 #include <QJsonArray>
 
-QJsonObject FamilyMember::toJson() const {
+static const QUuid kNonUuidIdNamespace("{1d6c2a3e-5f0b-4a8e-9c57-2b6f0e8d4a91}");
+
+MemberId memberIdFromString(const QString& s) {
+  if (s == "") {
+    return MemberId();
+  }
+  MemberId result(s);
+  if (result.isNull()) {
+    result = QUuid::createUuidV5(kNonUuidIdNamespace, s);
+  }
+  return result;
+}
+
+QString memberIdToString(const MemberId& id) { return id.isNull() ? "" : id.toString(); }
+
+static QJsonValue stringToJson(const QString& s, const FamilyMember::StringTable* stringTable) {
+  if (stringTable) {
+    auto iter = stringTable->find(s);
+    if (iter != stringTable->end()) {
+      return iter->second;
+    }
+  }
+  return s;
+}
+
+static QString stringFromJson(const QJsonValue& v, const QStringList* strings) {
+  if (v.isDouble()) {
+    int index = v.toInt();
+    Q_ASSERT(strings && index >= 0 && index < strings->size());
+    if (strings && index >= 0 && index < strings->size()) {
+      return (*strings)[index];
+    }
+    return "";
+  }
+  return v.toString();
+}
+
+QJsonObject FamilyMember::toJson(const StringTable* stringTable) const {
   QJsonObject o;
-  o["id"] = id;
-  o["title"] = title;
-  o["name"] = name;
-  o["spouseName"] = spouseName;
-  o["note"] = note;
+  o["id"] = memberIdToString(id);
+  o["title"] = stringToJson(title, stringTable);
+  o["name"] = stringToJson(name, stringTable);
+  o["spouseName"] = stringToJson(spouseName, stringTable);
+  o["note"] = stringToJson(note, stringTable);
+  if (noteOffset != -1) {
+    o["noteOffset"] = noteOffset;
+    o["noteSize"] = noteSize;
+    o["noteHash"] = QString::number(noteHash, 16);
+  }
+  if (portrait != "") {
+    o["portrait"] = portrait;
+  }
   o["isMale"] = isMale;
   o["isAlive"] = isAlive;
   o["isSpouseAlive"] = isSpouseAlive;
   o["children"] = [this]() -> QJsonArray {
     QJsonArray a;
-    for (const QString& child : children) {
-      a.append(child);
+    for (const MemberId& child : children) {
+      a.append(memberIdToString(child));
     }
     return a;
   }();
-  o["parentId"] = parentId;
+  o["parentId"] = memberIdToString(parentId);
   o["indexAsChild"] = indexAsChild;
   return o;
 }
 
-FamilyMember FamilyMember::fromJson(const QJsonObject& o) {
+FamilyMember FamilyMember::fromJson(const QJsonObject& o, const QStringList* strings) {
   FamilyMember result;
-  result.id = o["id"].toString();
-  result.title = o["title"].toString();
-  result.name = o["name"].toString();
-  result.spouseName = o["spouseName"].toString();
-  result.note = o["note"].toString();
+  result.id = memberIdFromString(o["id"].toString());
+  result.title = stringFromJson(o["title"], strings);
+  result.name = stringFromJson(o["name"], strings);
+  result.spouseName = stringFromJson(o["spouseName"], strings);
+  result.note = stringFromJson(o["note"], strings);
+  if (o.contains("noteOffset")) {
+    result.noteOffset = o["noteOffset"].toVariant().toLongLong();
+    result.noteSize = o["noteSize"].toInt();
+    result.noteHash = o["noteHash"].toString().toULongLong(nullptr, 16);
+  }
+  result.portrait = o["portrait"].toString();
   result.isMale = o["isMale"].toBool();
   result.isAlive = o["isAlive"].toBool();
   result.isSpouseAlive = o["isSpouseAlive"].toBool();
   if (o["children"].isArray()) {
     QJsonArray a = o["children"].toArray();
     for (const auto& v : a) {
-      result.children.push_back(v.toString());
+      result.children.push_back(memberIdFromString(v.toString()));
     }
   }
-  result.parentId = o["parentId"].toString();
+  result.parentId = memberIdFromString(o["parentId"].toString());
   result.indexAsChild = o["indexAsChild"].toInt();
   return result;
 }
@@ -26,37 +26,79 @@
 
 #include <QJsonObject>
 #include <QString>
+#include <QStringList>
 #include <QUuid>
+#include <cstring>
+#include <unordered_map>
+
+using MemberId = QUuid;
+
+struct MemberIdHash {
+  size_t operator()(const MemberId& id) const noexcept {
+    quint64 high = (quint64(id.data1) << 32) | (quint64(id.data2) << 16) | id.data3;
+    quint64 low = 0;
+    std::memcpy(&low, id.data4, sizeof(low));
+    return high ^ (low * 0x9e3779b97f4a7c15ULL);
+  }
+};
+
+// Ids are kept as 16-byte QUuids and written as "{...}" strings. A string that is not a uuid, e.g. from a hand-made
+// file, is mapped to a name-based uuid so references to it stay consistent.
+MemberId memberIdFromString(const QString& s);
+QString memberIdToString(const MemberId& id);
+
+struct SubTreeStats {
+  int memberCount = 1;
+  int livingCount = 0;
+  int maleCount = 0;
+  int femaleCount = 0;
+  int depth = 1;
+};
 
 struct FamilyMember {
   FamilyMember(bool doInit = false) {
     if (doInit) {
-      id = QUuid::createUuid().toString();
+      id = QUuid::createUuid();
     }
   }
-  bool isValid() const { return id != ""; }
+  bool isValid() const { return !id.isNull(); }
 
-  QJsonObject toJson() const;
-  static FamilyMember fromJson(const QJsonObject& o);
+  // With a string table, strings found in it are written as indexes into it.
+  using StringTable = std::unordered_map<QString, int>;
+  QJsonObject toJson(const StringTable* stringTable = nullptr) const;
+  static FamilyMember fromJson(const QJsonObject& o, const QStringList* strings = nullptr);
 
-  QString id;
+  MemberId id;
   QString title;
   QString name;
   QString spouseName;
   bool isMale = true;
   bool isAlive = false;
   bool isSpouseAlive = false;
+  // When noteOffset is not -1, note only holds a preview and the body is out of line, see FamilyNoteStore.
   QString note;
-  std::vector<QString> children;
-  QString parentId;
+  qint64 noteOffset = -1;
+  int noteSize = 0;
+  // Hash of the out of line body, written next to noteOffset so the content hash covers it without reading it.
+  quint64 noteHash = 0;
+  // Image file path, optional.
+  QString portrait;
+  std::vector<MemberId> children;
+  MemberId parentId;
   int indexAsChild = 0;
 
   void clearLayoutValue() {
     _layer = 0;
     _indexInSubTree = 0;
     _subTreeWidth = 1;
+    _stats = SubTreeStats();
   }
   int _layer = 0;
   int _indexInSubTree = 0;
   int _subTreeWidth = 1;
+  SubTreeStats _stats;
+
+  // Hash of the fields and of the children's subtree hashes in order, kept up to date by Family on every edit. Equal
+  // hashes mean equal branches, so it isn't cleared with the layout values.
+  quint64 _subTreeHash = 0;
 };
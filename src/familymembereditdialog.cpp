@@ -24,12 +24,21 @@
 
 #include "familymembereditdialog.h"
 
+#include <QFileDialog>
+
 #include "ui_familymembereditdialog.h"
 
 FamilyMemberEditDialog::FamilyMemberEditDialog(QWidget* parent) : QDialog(parent), ui(new Ui::FamilyMemberEditDialog) {
   ui->setupUi(this);
 
   connect(ui->buttonBox, &QDialogButtonBox::accepted, this, &FamilyMemberEditDialog::onDone);
+  connect(ui->portraitBrowseButton, &QToolButton::clicked, this, [this]() {
+    QString path = QFileDialog::getOpenFileName(this, tr("Portrait"), ui->portraitEdit->text(),
+                                                tr("Images (*.jpg *.jpeg *.png *.bmp)"));
+    if (path != "") {
+      ui->portraitEdit->setText(path);
+    }
+  });
 }
 
 FamilyMemberEditDialog::~FamilyMemberEditDialog() { delete ui; }
@@ -58,6 +67,7 @@ void FamilyMemberEditDialog::setMemberToUi(const FamilyMember& member) {
   ui->maleRadioButton->setChecked(member.isMale);
   ui->aliveCheckbox->setChecked(member.isAlive);
   ui->spouseAliveCheckbox->setChecked(member.isSpouseAlive);
+  ui->portraitEdit->setText(member.portrait);
   ui->noteEdit->setText(member.note);
 }
 
@@ -69,6 +79,7 @@ FamilyMember FamilyMemberEditDialog::getMemberFromUi() {
   member.isMale = ui->maleRadioButton->isChecked();
   member.isAlive = ui->aliveCheckbox->isChecked();
   member.isSpouseAlive = ui->spouseAliveCheckbox->isChecked();
+  member.portrait = ui->portraitEdit->text().trimmed();
   member.note = ui->noteEdit->toPlainText();
   return member;
 }
@@ -27,8 +27,13 @@
 #include <QGraphicsScene>
 #include <QGraphicsSceneEvent>
 #include <QMenu>
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QTextDocument>
 
 #include "familytreescene.h"
+#include "memoryreport.h"
+#include "portraitcache.h"
 
 static void centerIn(QGraphicsItem* item, const QRect& rect) {
   Q_ASSERT(item);
@@ -74,7 +79,7 @@ FamilyMemberItem::FamilyMemberItem(FamilyTreeScene* scene, const FamilyMember& m
 
 FamilyMemberItem::~FamilyMemberItem() {}
 
-QString FamilyMemberItem::id() const { return m_id; }
+MemberId FamilyMemberItem::id() const { return m_id; }
 
 void FamilyMemberItem::update(const FamilyMember& member) {
   QRect titleRect;
@@ -89,7 +94,14 @@ void FamilyMemberItem::update(const FamilyMember& member) {
     nameHeight -= kNoteHeight;
   }
 
-  titleRect = QRect(0, 0, kItemWidth, kTitleHeight);
+  m_portrait = member.portrait;
+  if (m_portrait != "") {
+    m_portraitRect = QRect(0, 0, kPortraitWidth, kTitleHeight);
+    titleRect = QRect(kPortraitWidth, 0, kItemWidth - kPortraitWidth, kTitleHeight);
+  } else {
+    m_portraitRect = QRect();
+    titleRect = QRect(0, 0, kItemWidth, kTitleHeight);
+  }
   if (hasSpouse) {
     int nameWidth = kItemWidth / 2;
     nameRect = QRect(0, kTitleHeight, nameWidth, nameHeight);
@@ -103,6 +115,7 @@ void FamilyMemberItem::update(const FamilyMember& member) {
   }
 
   QPainterPath path;
+  path.addRect(m_portraitRect);
   path.addRect(titleRect);
   path.addRect(nameRect);
   path.addRect(spouseNameRect);
@@ -136,6 +149,46 @@ void FamilyMemberItem::update(const FamilyMember& member) {
   centerIn(m_noteItem, noteRect);
 }
 
+qint64 FamilyMemberItem::memoryUsage() const {
+  qint64 result = sizeof(*this) + MemoryReport::kGraphicsItemPrivateSize;
+  result += path().elementCount() * sizeof(QPainterPath::Element);
+  result += MemoryReport::stringBytes(m_name) + MemoryReport::stringBytes(m_portrait);
+  for (const QGraphicsTextItem* item : {m_titleItem, m_nameItem, m_spouseNameItem, m_noteItem}) {
+    result += sizeof(*item) + MemoryReport::kGraphicsItemPrivateSize + MemoryReport::kTextDocumentPrivateSize;
+    result += item->document()->characterCount() * sizeof(QChar);
+  }
+  return result;
+}
+
+void FamilyMemberItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
+  QGraphicsPathItem::paint(painter, option, widget);
+  if (m_portrait == "") {
+    return;
+  }
+  QRect target = m_portraitRect.adjusted(2, 2, -2, -2);
+  int bucket = PortraitCache::zoomBucket(option->levelOfDetailFromTransform(painter->worldTransform()));
+  QPixmap pixmap = PortraitCache::instance().get(m_portrait, target.size(), bucket);
+  if (pixmap.isNull()) {
+    // Placeholder silhouette until the thumbnail is decoded.
+    painter->save();
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(QColor(0xe0, 0xe0, 0xe0));
+    painter->drawRect(target);
+    painter->setBrush(QColor(0xc0, 0xc0, 0xc0));
+    int headSize = target.width() / 2;
+    painter->drawEllipse(target.center().x() - headSize / 2, target.top() + 6, headSize, headSize);
+    painter->drawChord(target.left() + 4, target.top() + headSize + 8, target.width() - 8, target.height(), 0,
+                       180 * 16);
+    painter->restore();
+    return;
+  }
+  // The thumbnail covers the box, crop the overflow evenly.
+  QSize source = target.size().scaled(pixmap.size(), Qt::KeepAspectRatio);
+  painter->drawPixmap(target, pixmap,
+                      QRect(QPoint((pixmap.width() - source.width()) / 2, (pixmap.height() - source.height()) / 2),
+                            source));
+}
+
 qreal FamilyMemberItem::subTreeBeginX() const {
   qreal itemX = this->x();
   return itemX - (m_subTreeWidth - boundingRect().width()) / 2;
@@ -33,6 +33,7 @@ constexpr int kItemWidth = 100;
 constexpr int kItemHeight = 175;
 constexpr int kTitleHeight = 50;
 constexpr int kNoteHeight = 20;
+constexpr int kPortraitWidth = 40;
 constexpr int kItemVSpace = 40;
 constexpr int kItemHSpace = 40;
 constexpr int kArrowSize = 8;
@@ -46,7 +47,7 @@ class FamilyMemberItem : public QGraphicsPathItem {
                             const QPen& pen = QPen());
   ~FamilyMemberItem();
 
-  QString id() const;
+  MemberId id() const;
   QString name() const { return m_name; }
 
   void update(const FamilyMember& member);
@@ -61,6 +62,11 @@ class FamilyMemberItem : public QGraphicsPathItem {
   int width() const { return boundingRect().width(); }
   int height() const { return boundingRect().height(); }
 
+  void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget = nullptr) override;
+
+  // The item with its text items and their documents, estimated.
+  qint64 memoryUsage() const;
+
  protected:
   void contextMenuEvent(QGraphicsSceneContextMenuEvent* event) override;
   void mouseDoubleClickEvent(QGraphicsSceneMouseEvent* event) override;
@@ -71,9 +77,11 @@ class FamilyMemberItem : public QGraphicsPathItem {
  private:
   FamilyTreeScene* m_scene = nullptr;
 
-  QString m_id;
+  MemberId m_id;
   QString m_name;
   qreal m_subTreeWidth = 0;
+  QString m_portrait;
+  QRect m_portraitRect;
 
   ArrowItem* m_inArrow = nullptr;
 
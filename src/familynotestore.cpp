@@ -0,0 +1,69 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familynotestore.h"
+
+#include <QDebug>
+#include <QFile>
+
+void FamilyNoteStore::open(const QString& path, qint64 base) {
+  m_file = std::make_shared<File>();
+  m_file->path = path;
+  m_file->base = base;
+}
+
+void FamilyNoteStore::close() { m_file = nullptr; }
+
+void FamilyNoteStore::invalidate() {
+  if (m_file == nullptr) {
+    return;
+  }
+  QWriteLocker locker(&m_file->lock);
+  m_file->isValid = false;
+  locker.unlock();
+  m_file = nullptr;
+}
+
+QString FamilyNoteStore::read(qint64 offset, int size) const {
+  Q_ASSERT(isOpen());
+  if (m_file == nullptr) {
+    return QString();
+  }
+  QReadLocker locker(&m_file->lock);
+  if (!m_file->isValid) {
+    qDebug() << "note file was rewritten:" << m_file->path;
+    return QString();
+  }
+  QFile file(m_file->path);
+  if (!file.open(QFile::ReadOnly) || !file.seek(m_file->base + offset)) {
+    qDebug() << "can't read note from" << m_file->path << offset;
+    return QString();
+  }
+  QByteArray data = file.read(size);
+  if (data.size() != size) {
+    qDebug() << "short note read from" << m_file->path << offset;
+    return QString();
+  }
+  return QString::fromUtf8(data);
+}
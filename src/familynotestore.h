@@ -0,0 +1,58 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QReadWriteLock>
+#include <QString>
+#include <memory>
+
+// Note bodies kept out of line at the end of a saved file. Members only hold a preview and the byte range of the
+// body, which is read back from the file when it is needed.
+//
+// Copies, e.g. in snapshots, share the file. Once it is rewritten their offsets are meaningless, so the writer calls
+// invalidate() first and every copy reads nothing from then on.
+class FamilyNoteStore {
+ public:
+  void open(const QString& path, qint64 base);
+  // Detaches this store only, copies keep reading the file.
+  void close();
+  // Waits for reads in progress on any copy, later reads fail. Detaches this store as well.
+  void invalidate();
+  bool isOpen() const { return m_file != nullptr; }
+  QString path() const { return m_file ? m_file->path : QString(); }
+  qint64 base() const { return m_file ? m_file->base : 0; }
+
+  // Null when the store has been invalidated or the file can't be read.
+  QString read(qint64 offset, int size) const;
+
+ private:
+  struct File {
+    QString path;
+    qint64 base = 0;
+    QReadWriteLock lock;
+    bool isValid = true;
+  };
+  std::shared_ptr<File> m_file;
+};
@@ -0,0 +1,314 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familypinyinindex.h"
+
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <set>
+#include <unordered_set>
+
+#include "memoryreport.h"
+
+static const char* kPinyinTablePath = ":/resources/pinyin.txt";
+// Single latin letters match too much of the index to be worth a scan.
+static const size_t kMinQueryLength = 2;
+static const size_t kMaxScannedKeys = 20000;
+
+// Polyphonic characters read differently as a surname than the common reading in the table.
+static const std::unordered_map<char32_t, std::string> kSurnameReadings = {
+    {U'曾', "zeng"}, {U'长', "chang"}, {U'乐', "yue"}, {U'单', "shan"}, {U'解', "xie"},   {U'仇', "qiu"},
+    {U'区', "ou"},   {U'查', "zha"},   {U'朴', "piao"}, {U'盖', "ge"},   {U'员', "yun"},   {U'秘', "bi"},
+    {U'缪', "miao"}, {U'覃', "qin"},   {U'翟', "zhai"}, {U'召', "shao"}, {U'隗', "wei"},   {U'种', "chong"},
+    {U'折', "she"},  {U'繁', "po"},    {U'黑', "he"},   {U'重', "chong"}, {U'藏', "zang"}, {U'句', "gou"},
+    {U'能', "nai"},  {U'颉', "xie"},   {U'卜', "bu"},   {U'都', "du"},   {U'祭', "zhai"},  {U'澹', "tan"},
+};
+
+struct PinyinTable {
+  std::unordered_map<char32_t, std::string> charToSyllable;
+  std::unordered_set<std::string> syllables;
+  size_t maxSyllableLength = 0;
+};
+
+// One line per toneless syllable: "zhang 丈仉仗张章彰...". ü is written v, as typed on most keyboards, "lu" and "nu"
+// for those syllables are accepted as well.
+static const PinyinTable& pinyinTable() {
+  static const PinyinTable table = []() {
+    PinyinTable result;
+    QFile file(kPinyinTablePath);
+    bool ret = file.open(QFile::ReadOnly);
+    Q_ASSERT(ret);
+    if (!ret) {
+      qDebug() << "can't open" << kPinyinTablePath;
+      return result;
+    }
+    while (!file.atEnd()) {
+      QString line = QString::fromUtf8(file.readLine()).trimmed();
+      int space = line.indexOf(' ');
+      if (space <= 0) {
+        continue;
+      }
+      std::string syllable = line.left(space).toStdString();
+      for (char32_t c : line.mid(space + 1).toStdU32String()) {
+        result.charToSyllable[c] = syllable;
+      }
+      result.maxSyllableLength = std::max(result.maxSyllableLength, syllable.size());
+      result.syllables.insert(syllable);
+      std::replace(syllable.begin(), syllable.end(), 'v', 'u');
+      result.syllables.insert(syllable);
+    }
+    return result;
+  }();
+  return table;
+}
+
+// Splits typed pinyin such as "zhangsan" greedily into syllables, an unmatched tail like the "s" in "zhangs" is kept
+// as is so it still works as a prefix.
+static void appendSyllables(const std::string& latin, std::vector<std::string>& result) {
+  const PinyinTable& table = pinyinTable();
+  size_t pos = 0;
+  while (pos < latin.size()) {
+    size_t length = std::min(table.maxSyllableLength, latin.size() - pos);
+    while (length > 0 && !table.syllables.count(latin.substr(pos, length))) {
+      length--;
+    }
+    if (length == 0) {
+      result.push_back(latin.substr(pos));
+      return;
+    }
+    result.push_back(latin.substr(pos, length));
+    pos += length;
+  }
+}
+
+static std::string fuzzy(const std::string& syllable) {
+  std::string result = syllable;
+  if (result.size() >= 2 && result[1] == 'h' && (result[0] == 'z' || result[0] == 'c' || result[0] == 's')) {
+    result.erase(1, 1);
+  }
+  if (!result.empty() && result[0] == 'l') {
+    result[0] = 'n';
+  }
+  if (result.size() >= 3 && result.compare(result.size() - 2, 2, "ng") == 0) {
+    result.pop_back();
+  }
+  return result;
+}
+
+std::vector<std::string> FamilyPinyinIndex::toPinyin(const QString& text) {
+  const PinyinTable& table = pinyinTable();
+  std::vector<std::string> result;
+  std::string latin;
+  auto flushLatin = [&result, &latin]() {
+    if (!latin.empty()) {
+      appendSyllables(latin, result);
+      latin.clear();
+    }
+  };
+  for (char32_t c : text.toStdU32String()) {
+    if ((c >= U'a' && c <= U'z') || (c >= U'0' && c <= U'9')) {
+      latin += static_cast<char>(c);
+      continue;
+    }
+    if (c >= U'A' && c <= U'Z') {
+      latin += static_cast<char>(c - U'A' + U'a');
+      continue;
+    }
+    flushLatin();
+    auto iter = table.charToSyllable.find(c);
+    if (iter != table.charToSyllable.end()) {
+      result.push_back(iter->second);
+    }
+  }
+  flushLatin();
+  return result;
+}
+
+void FamilyPinyinIndex::clear() {
+  m_docIds.clear();
+  m_docNames.clear();
+  m_docKeys.clear();
+  m_idToDoc.clear();
+  for (Keys& keys : m_keys) {
+    keys.clear();
+  }
+}
+
+void FamilyPinyinIndex::update(const FamilyMember& member) {
+  Q_ASSERT(member.isValid());
+  QString names = member.name + "\n" + member.spouseName;
+  int doc = 0;
+  auto iter = m_idToDoc.find(member.id);
+  if (iter == m_idToDoc.end()) {
+    doc = m_docIds.size();
+    m_docIds.push_back(member.id);
+    m_docNames.push_back(names);
+    m_docKeys.emplace_back();
+    m_idToDoc[member.id] = doc;
+  } else {
+    doc = iter->second;
+    if (m_docNames[doc] == names) {
+      return;
+    }
+    removeKeys(doc);
+    m_docNames[doc] = names;
+  }
+  addField(doc, member.name, false);
+  addField(doc, member.spouseName, true);
+}
+
+void FamilyPinyinIndex::remove(const MemberId& id) {
+  auto iter = m_idToDoc.find(id);
+  if (iter == m_idToDoc.end()) {
+    return;
+  }
+  int doc = iter->second;
+  removeKeys(doc);
+  m_docIds[doc] = MemberId();
+  m_docNames[doc] = "";
+  m_idToDoc.erase(iter);
+}
+
+size_t FamilyPinyinIndex::memoryUsage() const {
+  size_t result = 0;
+  for (size_t i = 0; i < m_docIds.size(); i++) {
+    result += sizeof(MemberId) + sizeof(QString) + m_docNames[i].capacity() * sizeof(QChar);
+    result += sizeof(m_docKeys[i]) + m_docKeys[i].capacity() * sizeof(m_docKeys[i][0]);
+  }
+  result += m_idToDoc.size() * (sizeof(MemberId) + sizeof(int) + MemoryReport::kHashNodeOverhead);
+  result += m_idToDoc.bucket_count() * sizeof(void*);
+  // Multimap nodes carry a color and three links, keys longer than the small string buffer have their own block.
+  for (const Keys& keys : m_keys) {
+    for (const auto& pair : keys) {
+      result += sizeof(pair) + sizeof(void*) * 4;
+      if (pair.first.capacity() > std::string().capacity()) {
+        result += pair.first.capacity() + 1;
+      }
+    }
+  }
+  return result;
+}
+
+std::vector<FamilyPinyinIndex::Result> FamilyPinyinIndex::search(const QString& text, size_t limit) const {
+  std::string full;
+  std::string fuzzyQuery;
+  for (const std::string& syllable : toPinyin(text)) {
+    full += syllable;
+    fuzzyQuery += fuzzy(syllable);
+  }
+  if (full.size() < kMinQueryLength) {
+    return {};
+  }
+
+  std::unordered_map<int, int> docToScore;
+  auto scan = [this, &docToScore](Kind kind, const std::string& query, int baseScore) {
+    const Keys& keys = m_keys[kind];
+    size_t scanned = 0;
+    for (auto iter = keys.lower_bound(query);
+         iter != keys.end() && iter->first.compare(0, query.size(), query) == 0 && scanned < kMaxScannedKeys;
+         ++iter, ++scanned) {
+      const Posting& posting = iter->second;
+      int score = baseScore;
+      score += iter->first.size() == query.size() ? 40 : 0;
+      score += posting.atStart ? 20 : 0;
+      score += posting.isSpouse ? 0 : 5;
+      int& best = docToScore[posting.doc];
+      best = std::max(best, score);
+    }
+  };
+  scan(kFull, full, 300);
+  scan(kInitials, full, 200);
+  scan(kFuzzy, fuzzyQuery, 100);
+
+  std::vector<std::pair<int, int>> ranked;
+  ranked.reserve(docToScore.size());
+  for (const auto& pair : docToScore) {
+    ranked.emplace_back(-pair.second, pair.first);
+  }
+  size_t count = std::min(limit, ranked.size());
+  std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end());
+
+  std::vector<Result> result;
+  for (size_t i = 0; i < count; i++) {
+    result.push_back({m_docIds[ranked[i].second], -ranked[i].first});
+  }
+  return result;
+}
+
+void FamilyPinyinIndex::addField(int doc, const QString& text, bool isSpouse) {
+  // Each spelling of the name: the table readings, the surname reading of a polyphonic first character, and ü typed
+  // as u.
+  std::vector<std::vector<std::string>> spellings = {toPinyin(text)};
+  std::u32string chars = text.toStdU32String();
+  auto surname = chars.empty() ? kSurnameReadings.end() : kSurnameReadings.find(chars[0]);
+  if (surname != kSurnameReadings.end() && !spellings[0].empty()) {
+    spellings.push_back(spellings[0]);
+    spellings.back()[0] = surname->second;
+  }
+  for (size_t k = 0, count = spellings.size(); k < count; k++) {
+    std::vector<std::string> folded = spellings[k];
+    for (std::string& syllable : folded) {
+      std::replace(syllable.begin(), syllable.end(), 'v', 'u');
+    }
+    if (folded != spellings[k]) {
+      spellings.push_back(folded);
+    }
+  }
+
+  std::vector<std::pair<Kind, Keys::iterator>>& docKeys = m_docKeys[doc];
+  std::set<std::pair<Kind, std::string>> added;
+  auto add = [this, &docKeys, &added](Kind kind, const std::string& key, const Posting& posting) {
+    if (added.emplace(kind, key).second) {
+      docKeys.emplace_back(kind, m_keys[kind].emplace(key, posting));
+    }
+  };
+  for (const std::vector<std::string>& syllables : spellings) {
+    // Keys start at every syllable so the given name alone finds the member as well.
+    for (size_t i = 0; i < syllables.size(); i++) {
+      std::string full;
+      std::string initials;
+      std::string fuzzyKey;
+      for (size_t j = i; j < syllables.size(); j++) {
+        full += syllables[j];
+        initials += syllables[j][0];
+        fuzzyKey += fuzzy(syllables[j]);
+      }
+      Posting posting;
+      posting.doc = doc;
+      posting.isSpouse = isSpouse;
+      posting.atStart = i == 0;
+      add(kFull, full, posting);
+      add(kInitials, initials, posting);
+      add(kFuzzy, fuzzyKey, posting);
+    }
+  }
+}
+
+void FamilyPinyinIndex::removeKeys(int doc) {
+  for (const auto& pair : m_docKeys[doc]) {
+    m_keys[pair.first].erase(pair.second);
+  }
+  m_docKeys[doc].clear();
+}
@@ -0,0 +1,77 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <array>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "familymember.h"
+
+// Phonetic lookup of name and spouseName. Every syllable suffix of the full pinyin, the initials and a fuzzy folding
+// (zh/z, ch/c, sh/s, n/l, -ng/-n) is kept in a sorted map, so a query is a few prefix range scans. Names are also
+// indexed under the surname reading of a polyphonic first character and with ü spelled both v and u.
+class FamilyPinyinIndex {
+ public:
+  struct Result {
+    MemberId id;
+    int score = 0;
+  };
+
+  void clear();
+  void update(const FamilyMember& member);
+  void remove(const MemberId& id);
+
+  static constexpr size_t kDefaultLimit = 100;
+  std::vector<Result> search(const QString& text, size_t limit = kDefaultLimit) const;
+
+  size_t size() const { return m_idToDoc.size(); }
+  size_t memoryUsage() const;
+
+  static std::vector<std::string> toPinyin(const QString& text);
+
+ private:
+  enum Kind { kFull, kInitials, kFuzzy, kKindCount };
+
+  struct Posting {
+    int doc = 0;
+    bool isSpouse = false;
+    bool atStart = false;
+  };
+  using Keys = std::multimap<std::string, Posting>;
+
+  void addField(int doc, const QString& text, bool isSpouse);
+  void removeKeys(int doc);
+
+ private:
+  std::vector<MemberId> m_docIds;
+  std::vector<QString> m_docNames;
+  std::vector<std::vector<std::pair<Kind, Keys::iterator>>> m_docKeys;
+  std::unordered_map<MemberId, int, MemberIdHash> m_idToDoc;
+  std::array<Keys, kKindCount> m_keys;
+};
@@ -0,0 +1,182 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familysearchindex.h"
+
+#include <algorithm>
+
+#include "memoryreport.h"
+
+static const QChar kFieldSeparator(u'\n');
+
+static quint64 gramKey(char32_t first, char32_t second) { return (quint64(first) << 32) | second; }
+
+void FamilySearchIndex::clear() {
+  m_docIds.clear();
+  m_docTexts.clear();
+  m_idToDoc.clear();
+  m_postings.clear();
+}
+
+void FamilySearchIndex::update(const FamilyMember& member) {
+  Q_ASSERT(member.isValid());
+  QString text = normalize(member);
+  auto iter = m_idToDoc.find(member.id);
+  if (iter == m_idToDoc.end()) {
+    int doc = m_docIds.size();
+    m_docIds.push_back(member.id);
+    m_docTexts.push_back(text);
+    m_idToDoc[member.id] = doc;
+    addPostings(doc);
+    return;
+  }
+  int doc = iter->second;
+  if (m_docTexts[doc] == text) {
+    return;
+  }
+  removePostings(doc);
+  m_docTexts[doc] = text;
+  addPostings(doc);
+}
+
+void FamilySearchIndex::remove(const MemberId& id) {
+  auto iter = m_idToDoc.find(id);
+  if (iter == m_idToDoc.end()) {
+    return;
+  }
+  int doc = iter->second;
+  removePostings(doc);
+  m_docIds[doc] = MemberId();
+  m_docTexts[doc] = "";
+  m_idToDoc.erase(iter);
+}
+
+std::vector<MemberId> FamilySearchIndex::search(const QString& text, Match match, size_t limit) const {
+  std::vector<MemberId> result;
+  QString query = text.toCaseFolded().remove(kFieldSeparator);
+  if (query.isEmpty()) {
+    return result;
+  }
+
+  std::u32string s = query.toStdU32String();
+  std::vector<quint64> keys;
+  if (s.size() == 1) {
+    keys.push_back(gramKey(s[0], 0));
+  } else {
+    for (size_t i = 0; i + 1 < s.size(); i++) {
+      keys.push_back(gramKey(s[i], s[i + 1]));
+    }
+  }
+
+  // Verifying the rarest gram's postings is cheaper than intersecting all of them for short name queries.
+  const std::vector<int>* candidates = nullptr;
+  for (quint64 key : keys) {
+    auto iter = m_postings.find(key);
+    if (iter == m_postings.end()) {
+      return result;
+    }
+    if (candidates == nullptr || iter->second.size() < candidates->size()) {
+      candidates = &iter->second;
+    }
+  }
+
+  QString needle = match == Match::Prefix ? QString(kFieldSeparator) + query : query;
+  for (int doc : *candidates) {
+    if (m_docTexts[doc].contains(needle)) {
+      result.push_back(m_docIds[doc]);
+      if (result.size() >= limit) {
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+size_t FamilySearchIndex::memoryUsage() const {
+  size_t result = 0;
+  for (size_t i = 0; i < m_docIds.size(); i++) {
+    result += sizeof(MemberId) + sizeof(QString) + m_docTexts[i].capacity() * sizeof(QChar);
+  }
+  result += m_idToDoc.size() * (sizeof(MemberId) + sizeof(int) + MemoryReport::kHashNodeOverhead);
+  result += m_idToDoc.bucket_count() * sizeof(void*);
+  for (const auto& pair : m_postings) {
+    result += sizeof(pair) + MemoryReport::kHashNodeOverhead + pair.second.capacity() * sizeof(int);
+  }
+  result += m_postings.bucket_count() * sizeof(void*);
+  return result;
+}
+
+QString FamilySearchIndex::normalize(const FamilyMember& member) {
+  QString result;
+  for (const QString* field : {&member.title, &member.name, &member.spouseName, &member.note}) {
+    result += kFieldSeparator;
+    result += field->toCaseFolded().remove(kFieldSeparator);
+  }
+  return result;
+}
+
+std::vector<quint64> FamilySearchIndex::grams(const QString& text) {
+  std::vector<quint64> result;
+  std::u32string s = text.toStdU32String();
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == kFieldSeparator.unicode()) {
+      continue;
+    }
+    result.push_back(gramKey(s[i], 0));
+    if (i + 1 < s.size() && s[i + 1] != kFieldSeparator.unicode()) {
+      result.push_back(gramKey(s[i], s[i + 1]));
+    }
+  }
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+void FamilySearchIndex::addPostings(int doc) {
+  for (quint64 key : grams(m_docTexts[doc])) {
+    std::vector<int>& postings = m_postings[key];
+    if (postings.empty() || postings.back() < doc) {
+      postings.push_back(doc);
+    } else {
+      postings.insert(std::lower_bound(postings.begin(), postings.end(), doc), doc);
+    }
+  }
+}
+
+void FamilySearchIndex::removePostings(int doc) {
+  for (quint64 key : grams(m_docTexts[doc])) {
+    auto iter = m_postings.find(key);
+    if (iter == m_postings.end()) {
+      continue;
+    }
+    std::vector<int>& postings = iter->second;
+    auto pos = std::lower_bound(postings.begin(), postings.end(), doc);
+    if (pos != postings.end() && *pos == doc) {
+      postings.erase(pos);
+    }
+    if (postings.empty()) {
+      m_postings.erase(iter);
+    }
+  }
+}
@@ -0,0 +1,62 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <unordered_map>
+#include <vector>
+
+#include "familymember.h"
+
+// Character unigram/bigram index over title, name, spouse name and note. Bigrams work for CJK names where there are
+// no word boundaries, single characters fall back to the unigram postings.
+class FamilySearchIndex {
+ public:
+  enum class Match { Substring, Prefix };
+  // Searches stop at this many matches, callers tell the user when a result list is full.
+  static constexpr size_t kDefaultLimit = 100;
+
+  void clear();
+  void update(const FamilyMember& member);
+  void remove(const MemberId& id);
+
+  std::vector<MemberId> search(const QString& text, Match match = Match::Substring,
+                               size_t limit = kDefaultLimit) const;
+
+  size_t size() const { return m_idToDoc.size(); }
+  size_t memoryUsage() const;
+
+ private:
+  static QString normalize(const FamilyMember& member);
+  static std::vector<quint64> grams(const QString& text);
+  void addPostings(int doc);
+  void removePostings(int doc);
+
+ private:
+  std::vector<MemberId> m_docIds;
+  std::vector<QString> m_docTexts;
+  std::unordered_map<MemberId, int, MemberIdHash> m_idToDoc;
+  std::unordered_map<quint64, std::vector<int>> m_postings;
+};
@@ -0,0 +1,143 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familysnapshot.h"
+
+#include "familydiff.h"
+#include "trace.h"
+
+const FamilyMember* FamilySnapshot::member(const MemberId& id) const {
+  const Chunk& chunk = *m_chunks[chunkOf(id)];
+  auto iter = chunk.find(id);
+  return iter == chunk.end() ? nullptr : &iter->second;
+}
+
+QString FamilySnapshot::fullNote(const MemberId& id) const {
+  const FamilyMember* found = member(id);
+  if (found == nullptr) {
+    return "";
+  }
+  if (found->noteOffset == -1 || !m_noteStore.isOpen()) {
+    return found->note;
+  }
+  QString result = m_noteStore.read(found->noteOffset, found->noteSize);
+  return result.isNull() ? found->note : result;
+}
+
+void FamilySnapshot::diff(const FamilySnapshot* from, const FamilySnapshot& to,
+                          std::vector<const FamilyMember*>& changed, std::vector<MemberId>& removed) {
+  TRACE_SCOPE("FamilySnapshot::diff");
+  for (int i = 0; i < kChunkCount; i++) {
+    const Chunk* fromChunk = from ? from->m_chunks[i].get() : nullptr;
+    const Chunk& toChunk = *to.m_chunks[i];
+    if (fromChunk == &toChunk) {
+      continue;
+    }
+    for (const auto& pair : toChunk) {
+      if (fromChunk == nullptr) {
+        changed.push_back(&pair.second);
+        continue;
+      }
+      auto iter = fromChunk->find(pair.first);
+      if (iter == fromChunk->end() || !FamilyDiff::isSameMember(iter->second, pair.second)) {
+        changed.push_back(&pair.second);
+      }
+    }
+    if (fromChunk == nullptr) {
+      continue;
+    }
+    for (const auto& pair : *fromChunk) {
+      if (!toChunk.count(pair.first)) {
+        removed.push_back(pair.first);
+      }
+    }
+  }
+}
+
+void FamilySnapshotBuilder::reset() {
+  m_chunks.clear();
+  m_touchedIds.clear();
+  m_isAllTouched = true;
+}
+
+void FamilySnapshotBuilder::touch(const MemberId& id) {
+  if (m_isAllTouched) {
+    return;
+  }
+  m_touchedIds[FamilySnapshot::chunkOf(id)].push_back(id);
+}
+
+std::shared_ptr<const FamilySnapshot> FamilySnapshotBuilder::build(const MemberId& rootId, const QString& title,
+                                                                   quint64 contentHash,
+                                                                   const FamilyNoteStore& noteStore,
+                                                                   const std::map<MemberId, FamilyMember>& members) {
+  TRACE_SCOPE("FamilySnapshotBuilder::build");
+  auto copy = [](const FamilyMember& member) {
+    FamilyMember result = member;
+    quint64 hash = result._subTreeHash;
+    result.clearLayoutValue();
+    result._subTreeHash = hash;
+    return result;
+  };
+  if (m_isAllTouched) {
+    std::vector<std::shared_ptr<FamilySnapshot::Chunk>> chunks(FamilySnapshot::kChunkCount);
+    for (auto& chunk : chunks) {
+      chunk = std::make_shared<FamilySnapshot::Chunk>();
+    }
+    for (const auto& pair : members) {
+      chunks[FamilySnapshot::chunkOf(pair.first)]->emplace(pair.first, copy(pair.second));
+    }
+    m_chunks.assign(chunks.begin(), chunks.end());
+    m_touchedIds.assign(FamilySnapshot::kChunkCount, {});
+    m_isAllTouched = false;
+  } else {
+    for (int i = 0; i < FamilySnapshot::kChunkCount; i++) {
+      std::vector<MemberId>& touchedIds = m_touchedIds[i];
+      if (touchedIds.empty()) {
+        continue;
+      }
+      // Older snapshots may still be reading the current chunk, edits go into a copy.
+      auto chunk = std::make_shared<FamilySnapshot::Chunk>(*m_chunks[i]);
+      for (const MemberId& id : touchedIds) {
+        auto iter = members.find(id);
+        if (iter == members.end()) {
+          chunk->erase(id);
+        } else {
+          (*chunk)[id] = copy(iter->second);
+        }
+      }
+      m_chunks[i] = chunk;
+      touchedIds.clear();
+    }
+  }
+
+  std::shared_ptr<FamilySnapshot> result(new FamilySnapshot);
+  result->m_rootId = rootId;
+  result->m_title = title;
+  result->m_contentHash = contentHash;
+  result->m_size = members.size();
+  result->m_noteStore = noteStore;
+  result->m_chunks = m_chunks;
+  return result;
+}
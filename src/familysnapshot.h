@@ -0,0 +1,98 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "familymember.h"
+#include "familynotestore.h"
+
+// Immutable copy of a Family at one point in time. It is never written after it is built, so any thread can read it
+// without locking while the GUI thread keeps editing the family. Members live in shared chunks: a new snapshot copies
+// only the chunks edited since the previous one and shares the rest.
+//
+// Members hold their fields, links and _subTreeHash, the layout values are cleared.
+class FamilySnapshot {
+ public:
+  MemberId rootId() const { return m_rootId; }
+  const QString& title() const { return m_title; }
+  quint64 contentHash() const { return m_contentHash; }
+  int size() const { return m_size; }
+
+  // Null when there is no such member.
+  const FamilyMember* member(const MemberId& id) const;
+  // Reads out of line bodies from the file the family was loaded from or last saved to. A save of the family
+  // invalidates them, after it only the previews are returned, see FamilyNoteStore::invalidate().
+  QString fullNote(const MemberId& id) const;
+
+  // Members of to that are new or differ from from, and the ids only from has. Chunks the two share are skipped, a
+  // null from counts every member of to as changed.
+  static void diff(const FamilySnapshot* from, const FamilySnapshot& to, std::vector<const FamilyMember*>& changed,
+                   std::vector<MemberId>& removed);
+
+  template <typename Visit>
+  void forEachMember(Visit visit) const {
+    for (const auto& chunk : m_chunks) {
+      for (const auto& pair : *chunk) {
+        visit(pair.second);
+      }
+    }
+  }
+
+ private:
+  friend class FamilySnapshotBuilder;
+  using Chunk = std::unordered_map<MemberId, FamilyMember, MemberIdHash>;
+  static constexpr int kChunkCount = 256;
+  static int chunkOf(const MemberId& id) { return MemberIdHash()(id) % kChunkCount; }
+
+  MemberId m_rootId;
+  QString m_title;
+  quint64 m_contentHash = 0;
+  int m_size = 0;
+  FamilyNoteStore m_noteStore;
+  std::vector<std::shared_ptr<const Chunk>> m_chunks;
+};
+
+// Kept by Family on the GUI thread: records which members changed and rebuilds only their chunks on the next build.
+class FamilySnapshotBuilder {
+ public:
+  // Everything changed, e.g. after a load.
+  void reset();
+  // The member was added, edited or removed.
+  void touch(const MemberId& id);
+
+  std::shared_ptr<const FamilySnapshot> build(const MemberId& rootId, const QString& title, quint64 contentHash,
+                                              const FamilyNoteStore& noteStore,
+                                              const std::map<MemberId, FamilyMember>& members);
+
+ private:
+  std::vector<std::shared_ptr<const FamilySnapshot::Chunk>> m_chunks;
+  std::vector<std::vector<MemberId>> m_touchedIds;
+  bool m_isAllTouched = true;
+};
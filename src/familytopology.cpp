@@ -0,0 +1,134 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familytopology.h"
+
+#include <QDebug>
+
+#include "memoryreport.h"
+
+void FamilyTopology::clear() {
+  m_ids.clear();
+  m_members.clear();
+  m_idToIndex.clear();
+  m_parents.clear();
+  m_layers.clear();
+  m_childOffsets.clear();
+  m_layerOffsets.clear();
+}
+
+void FamilyTopology::build(const MemberId& rootId, std::map<MemberId, FamilyMember>& members) {
+  clear();
+  auto root = members.find(rootId);
+  if (root == members.end()) {
+    return;
+  }
+  m_ids.reserve(members.size());
+  m_members.reserve(members.size());
+  m_idToIndex.reserve(members.size());
+  m_parents.reserve(members.size());
+  m_layers.reserve(members.size());
+  m_childOffsets.reserve(members.size() + 1);
+
+  m_ids.push_back(rootId);
+  m_members.push_back(&root->second);
+  m_idToIndex[rootId] = 0;
+  m_parents.push_back(-1);
+  m_layers.push_back(0);
+  for (size_t i = 0; i < m_ids.size(); i++) {
+    if (i == 0 || m_layers[i] != m_layers[i - 1]) {
+      m_layerOffsets.push_back(i);
+    }
+    m_childOffsets.push_back(m_ids.size());
+    for (const MemberId& childId : m_members[i]->children) {
+      auto child = members.find(childId);
+      if (child == members.end() || m_idToIndex.count(childId)) {
+        qDebug() << "skip child:" << childId;
+        continue;
+      }
+      m_idToIndex[childId] = m_ids.size();
+      m_ids.push_back(childId);
+      m_members.push_back(&child->second);
+      m_parents.push_back(i);
+      m_layers.push_back(m_layers[i] + 1);
+    }
+  }
+  m_childOffsets.push_back(m_ids.size());
+  m_layerOffsets.push_back(m_ids.size());
+}
+
+void FamilyTopology::addLeaf(const MemberId& parentId, FamilyMember* member) {
+  const MemberId& id = member->id;
+  int parent = indexOf(parentId);
+  Q_ASSERT(parent != -1);
+  Q_ASSERT(indexOf(id) == -1);
+  if (parent == -1 || indexOf(id) != -1) {
+    return;
+  }
+  int pos = m_childOffsets[parent + 1];
+  int layer = m_layers[parent] + 1;
+
+  // Only members from pos on move, and a parent always comes before its children, so nothing before pos points at or
+  // after it.
+  for (size_t i = pos; i < m_ids.size(); i++) {
+    m_idToIndex.find(m_ids[i])->second++;
+    if (m_parents[i] >= pos) {
+      m_parents[i]++;
+    }
+  }
+  // Members after the parent have their children at or after pos, the parent's own range only grows at the end.
+  for (size_t i = parent + 1; i < m_childOffsets.size(); i++) {
+    if (m_childOffsets[i] >= pos) {
+      m_childOffsets[i]++;
+    }
+  }
+  m_childOffsets.insert(m_childOffsets.begin() + pos, m_childOffsets[pos]);
+  if (layer == layerCount()) {
+    m_layerOffsets.push_back(m_ids.size() + 1);
+  } else {
+    for (size_t l = layer + 1; l < m_layerOffsets.size(); l++) {
+      m_layerOffsets[l]++;
+    }
+  }
+
+  m_ids.insert(m_ids.begin() + pos, id);
+  m_members.insert(m_members.begin() + pos, member);
+  m_parents.insert(m_parents.begin() + pos, parent);
+  m_layers.insert(m_layers.begin() + pos, layer);
+  m_idToIndex[id] = pos;
+}
+
+size_t FamilyTopology::memoryUsage() const {
+  size_t result = m_ids.capacity() * sizeof(MemberId) + m_members.capacity() * sizeof(FamilyMember*);
+  result += (m_parents.capacity() + m_layers.capacity() + m_childOffsets.capacity() + m_layerOffsets.capacity()) *
+            sizeof(int);
+  result += m_idToIndex.size() * (sizeof(MemberId) + sizeof(int) + MemoryReport::kHashNodeOverhead);
+  result += m_idToIndex.bucket_count() * sizeof(void*);
+  return result;
+}
+
+int FamilyTopology::indexOf(const MemberId& id) const {
+  auto iter = m_idToIndex.find(id);
+  return iter == m_idToIndex.end() ? -1 : iter->second;
+}
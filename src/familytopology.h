@@ -0,0 +1,81 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "familymember.h"
+
+// The tree as flat index arrays in breadth-first order. Members of a layer are contiguous, and so are the children of
+// a member, so layer and subtree walks are sequential scans without map lookups.
+class FamilyTopology {
+ public:
+  struct IdRange {
+    const MemberId* first = nullptr;
+    const MemberId* last = nullptr;
+    const MemberId* begin() const { return first; }
+    const MemberId* end() const { return last; }
+    int size() const { return last - first; }
+  };
+
+  void clear();
+  // Keeps pointers into members, they stay valid until a member is erased, which must be followed by another build.
+  void build(const MemberId& rootId, std::map<MemberId, FamilyMember>& members);
+  // Appends member as the last child of parentId, shifting the arrays instead of rebuilding them.
+  void addLeaf(const MemberId& parentId, FamilyMember* member);
+
+  int size() const { return m_ids.size(); }
+  size_t memoryUsage() const;
+  int indexOf(const MemberId& id) const;
+  const MemberId& idAt(int index) const { return m_ids[index]; }
+  const FamilyMember& memberAt(int index) const { return *m_members[index]; }
+  FamilyMember& memberAt(int index) { return *m_members[index]; }
+  int parent(int index) const { return m_parents[index]; }
+  int layer(int index) const { return m_layers[index]; }
+
+  int childBegin(int index) const { return m_childOffsets[index]; }
+  int childEnd(int index) const { return m_childOffsets[index + 1]; }
+
+  int layerCount() const { return m_layerOffsets.empty() ? 0 : m_layerOffsets.size() - 1; }
+  int layerBegin(int layer) const { return m_layerOffsets[layer]; }
+  int layerEnd(int layer) const { return m_layerOffsets[layer + 1]; }
+  // Members of a generation from left to right.
+  IdRange generation(int layer) const {
+    return {m_ids.data() + m_layerOffsets[layer], m_ids.data() + m_layerOffsets[layer + 1]};
+  }
+
+ private:
+  std::vector<MemberId> m_ids;
+  std::vector<FamilyMember*> m_members;
+  std::unordered_map<MemberId, int, MemberIdHash> m_idToIndex;
+  std::vector<int> m_parents;
+  std::vector<int> m_layers;
+  // Children of i are [m_childOffsets[i], m_childOffsets[i + 1]), members of layer l are
+  // [m_layerOffsets[l], m_layerOffsets[l + 1]).
+  std::vector<int> m_childOffsets;
+  std::vector<int> m_layerOffsets;
+};
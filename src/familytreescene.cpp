@@ -24,41 +24,82 @@
 
 #include "familytreescene.h"
 
+#include <QDebug>
+#include <QElapsedTimer>
 #include <QGraphicsSceneMouseEvent>
+#include <QPainter>
+#include <algorithm>
+#include <unordered_set>
 
 #include "arrowitem.h"
 #include "family.h"
 #include "familymemberitem.h"
 #include "familytitleitem.h"
+#include "memoryreport.h"
+#include "perfstats.h"
+#include "portraitcache.h"
+#include "trace.h"
+
+static constexpr int kRebuildFrameBudgetMs = 8;
 
 FamilyTreeScene::FamilyTreeScene(QMenu* itemMenu, QObject* parent) : QGraphicsScene(parent), m_itemMenu(itemMenu) {
+  m_rebuildTimer.setSingleShot(true);
+  m_rebuildTimer.setInterval(0);
+  connect(&m_rebuildTimer, &QTimer::timeout, this, &FamilyTreeScene::onRebuildTimeout);
+  connect(&PortraitCache::instance(), &PortraitCache::portraitsReady, this, [this]() { update(); });
   resetItems();
 }
 
-FamilyMemberItem* FamilyTreeScene::getItem(const QString& id) {
-  if (m_idToItem.count(id) == 0) {
+FamilyMemberItem* FamilyTreeScene::getItem(const MemberId& id) {
+  auto iter = m_idToItem.find(id);
+  if (iter == m_idToItem.end()) {
     return nullptr;
   }
-  FamilyMemberItem* item = m_idToItem[id];
-  Q_ASSERT(item);
-  return item;
+  Q_ASSERT(iter->second);
+  return iter->second;
 }
 
-QString FamilyTreeScene::selectedMemberId() const {
+MemberId FamilyTreeScene::selectedMemberId() const {
   QList<QGraphicsItem*> selected = selectedItems();
   if (selected.size() != 1) {
-    return "";
+    return MemberId();
   }
   FamilyMemberItem* item = dynamic_cast<FamilyMemberItem*>(selected[0]);
   Q_ASSERT(item);
   return item->id();
 }
 
-void FamilyTreeScene::onMemberUpdated(const QString& id) {
+std::vector<MemberId> FamilyTreeScene::selectedMemberIds() const {
+  std::vector<MemberId> result;
+  for (QGraphicsItem* selected : selectedItems()) {
+    FamilyMemberItem* item = dynamic_cast<FamilyMemberItem*>(selected);
+    if (item) {
+      result.push_back(item->id());
+    }
+  }
+  return result;
+}
+
+FamilyMemberItem* FamilyTreeScene::selectMember(const MemberId& id) {
+  int index = m_family ? m_family->topology().indexOf(id) : -1;
+  if (index == -1) {
+    return nullptr;
+  }
+  // While a build is running only the path down to the member is placed, the build picks up the rest.
+  FamilyMemberItem* item = m_rebuildTimer.isActive() ? buildPath(index) : getItem(id);
+  if (item == nullptr) {
+    return nullptr;
+  }
+  clearSelection();
+  item->setSelected(true);
+  return item;
+}
+
+void FamilyTreeScene::onMemberUpdated(const MemberId& id) {
   FamilyMember member = m_family->getMember(id);
   Q_ASSERT(member.isValid());
-  Q_ASSERT(m_idToItem.count(id));
   if (!m_idToItem.count(id)) {
+    // Not built yet, the pending rebuild will pick up the new value.
     return;
   }
   FamilyMemberItem* item = m_idToItem[id];
@@ -74,75 +115,213 @@ void FamilyTreeScene::onRelayouted() {
   Q_ASSERT(m_family);
   Q_ASSERT(m_family->isValid());
 
-  resetItems();
+  // Reserve the final extent up front so the view can be panned while items are still being added.
+  const FamilyMember& root = m_family->topology().memberAt(0);
+  setSceneRect(sceneRect().united(QRectF(0, 0, root._subTreeWidth * (kItemWidth + kItemHSpace) - kItemHSpace,
+                                         m_family->layerCount() * (kItemHeight + kItemVSpace) - kItemVSpace)));
 
-  std::vector<QString> layerIds({m_family->rootId()});
-  while (layerIds.size() > 0) {
-    QString curParentId;
-    int layoutedChildrenWidth = 0;
-
-    std::vector<QString> nextLayerIds;
-    for (const QString& id : layerIds) {
-      FamilyMember member = m_family->getMember(id);
-      Q_ASSERT(member.isValid());
-      nextLayerIds.insert(nextLayerIds.end(), member.children.begin(), member.children.end());
-      FamilyMemberItem* item = new FamilyMemberItem(this, member);
-      addMemberItem(item);
-
-      qreal totalWidth = member._subTreeWidth * (kItemWidth + kItemHSpace) - kItemHSpace;
-      item->setSubTreeWidth(totalWidth);
-
-      if (member.parentId != curParentId) {
-        curParentId = member.parentId;
-        layoutedChildrenWidth = 0;
-      }
+  // Items of removed members go right away, the slices only add and move items, so no card of a deleted member is left
+  // to click while they run.
+  removeStaleItems();
+
+  // Any build in progress is stale now, restart from the root with the newest layout.
+  m_rebuild.pending = true;
+  if (!m_rebuildTimer.isActive()) {
+    m_rebuildTimer.start();
+  }
+}
+
+void FamilyTreeScene::onRebuildTimeout() {
+  TRACE_SCOPE("FamilyTreeScene::rebuildSlice");
+  QElapsedTimer timer;
+  timer.start();
+  while (rebuildStep()) {
+    if (timer.elapsed() >= kRebuildFrameBudgetMs) {
+      m_rebuild.elapsedNs += timer.nsecsElapsed();
+      m_rebuildTimer.start();
+      emit rebuildProgress(m_rebuild.index, m_family->size());
+      return;
+    }
+  }
+  PerfStats::sceneRebuildNs = m_rebuild.elapsedNs + timer.nsecsElapsed();
+  emit rebuildProgress(m_family->size(), m_family->size());
+}
+
+void FamilyTreeScene::flushRebuild() {
+  if (!m_rebuildTimer.isActive()) {
+    return;
+  }
+  TRACE_SCOPE("FamilyTreeScene::flushRebuild");
+  QElapsedTimer timer;
+  timer.start();
+  m_rebuildTimer.stop();
+  while (rebuildStep()) {
+  }
+  PerfStats::sceneRebuildNs = m_rebuild.elapsedNs + timer.nsecsElapsed();
+  emit rebuildProgress(m_family->size(), m_family->size());
+}
+
+QImage FamilyTreeScene::renderImage(const QRectF& sourceRect) {
+  TRACE_SCOPE("FamilyTreeScene::renderImage");
+  constexpr int kPadding = 30;
+  constexpr int kMargin = 20;
+  QImage image(sourceRect.width() + (kPadding + kMargin) * 2, sourceRect.height() + (kPadding + kMargin) * 2,
+               QImage::Format_ARGB32);
+  if (image.isNull()) {
+    qDebug() << "image too large:" << sourceRect;
+    return image;
+  }
+  image.fill(Qt::white);
+  MemoryReport::exportImageBytes = image.sizeInBytes();
+  QPainter painter(&image);
+  PortraitCache::instance().setBlocking(true);
+  render(&painter, QRectF(QPointF(kPadding + kMargin, kPadding + kMargin), sourceRect.size()), sourceRect);
+  PortraitCache::instance().setBlocking(false);
+  painter.drawRect(kMargin, kMargin, sourceRect.width() + kPadding * 2, sourceRect.height() + kPadding * 2);
+  return image;
+}
+
+void FamilyTreeScene::reportMemory(MemoryReport& report) const {
+  qint64 itemBytes = 0;
+  qint64 arrowCount = 0;
+  qint64 arrowBytes = 0;
+  for (const auto& pair : m_idToItem) {
+    itemBytes += pair.second->memoryUsage();
+    if (pair.second->inArrow()) {
+      arrowCount++;
+      arrowBytes += pair.second->inArrow()->memoryUsage();
+    }
+  }
+  qint64 size = m_idToItem.size();
+  report.add("Member items", size, itemBytes + size * (sizeof(*m_idToItem.begin()) + MemoryReport::kTreeNodeOverhead));
+  report.add("Arrow items", arrowCount, arrowBytes);
+}
+
+bool FamilyTreeScene::rebuildStep() {
+  if (m_family == nullptr) {
+    return false;
+  }
+  if (m_rebuild.pending) {
+    m_rebuild = RebuildState();
+  }
+  if (m_rebuild.index == m_family->topology().size()) {
+    onTitleUpdated();
+    setSceneRect(QRectF());
+    return false;
+  }
+  layoutMember(m_rebuild.index++);
+  return true;
+}
+
+void FamilyTreeScene::layoutMember(int index) {
+  const FamilyTopology& topology = m_family->topology();
+  if (topology.parent(index) != m_rebuild.curParent) {
+    m_rebuild.curParent = topology.parent(index);
+    m_rebuild.layoutedChildrenWidth = 0;
+  }
+  m_rebuild.layoutedChildrenWidth += placeMember(index, m_rebuild.layoutedChildrenWidth) + kItemHSpace;
+}
+
+FamilyMemberItem* FamilyTreeScene::buildPath(int index) {
+  const FamilyTopology& topology = m_family->topology();
+  std::vector<int> path;
+  for (int i = index; i != -1; i = topology.parent(i)) {
+    path.push_back(i);
+  }
+  for (auto iter = path.rbegin(); iter != path.rend(); ++iter) {
+    int parent = topology.parent(*iter);
+    qreal offset = 0;
+    for (int sibling = parent == -1 ? *iter : topology.childBegin(parent); sibling != *iter; sibling++) {
+      offset += topology.memberAt(sibling)._subTreeWidth * (kItemWidth + kItemHSpace);
+    }
+    placeMember(*iter, offset);
+  }
+  return getItem(topology.idAt(index));
+}
+
+qreal FamilyTreeScene::placeMember(int index, qreal offsetInParent) {
+  const FamilyTopology& topology = m_family->topology();
+  const FamilyMember& member = topology.memberAt(index);
+  Q_ASSERT(member.isValid());
 
-      qreal subTreeBeginX = [this, &member]() -> qreal {
-        QString parentId = member.parentId;
-        if (parentId == "") {
-          return 0;
-        }
-        FamilyMemberItem* item = getItem(parentId);
-        if (item == nullptr) {
-          return 0;
-        }
-        return item->subTreeBeginX();
-      }();
-
-      qreal beginX = subTreeBeginX + layoutedChildrenWidth;
-      item->setY(member._layer * (kItemHeight + kItemVSpace));
-      item->setX(beginX + (totalWidth - item->boundingRect().width()) / 2);
-      if (item->inArrow()) {
-        item->inArrow()->updatePosition();
+  FamilyMemberItem* parentItem = topology.parent(index) == -1 ? nullptr : getItem(member.parentId);
+  FamilyMemberItem* item = getItem(member.id);
+  if (item == nullptr) {
+    item = new FamilyMemberItem(this, member);
+    addMemberItem(item, parentItem);
+  } else {
+    // Moved under another parent, or its arrow went with a removed parent.
+    ArrowItem* arrow = item->inArrow();
+    if (arrow == nullptr ? parentItem != nullptr : arrow->startItem() != parentItem) {
+      delete arrow;
+      item->setInArrow(nullptr);
+      if (parentItem) {
+        addItem(new ArrowItem(parentItem, item));
       }
-      // qDebug() << member.id << member.name << item->boundingRect();
-      layoutedChildrenWidth += totalWidth + kItemHSpace;
     }
-    layerIds.swap(nextLayerIds);
   }
 
-  onTitleUpdated();
+  qreal totalWidth = member._subTreeWidth * (kItemWidth + kItemHSpace) - kItemHSpace;
+  item->setSubTreeWidth(totalWidth);
+
+  qreal beginX = (parentItem ? parentItem->subTreeBeginX() : 0) + offsetInParent;
+  item->setY(member._layer * (kItemHeight + kItemVSpace));
+  item->setX(beginX + (totalWidth - item->boundingRect().width()) / 2);
+  if (item->inArrow()) {
+    item->inArrow()->updatePosition();
+  }
+  return totalWidth;
+}
+
+void FamilyTreeScene::removeStaleItems() {
+  const FamilyTopology& topology = m_family->topology();
+  std::unordered_set<FamilyMemberItem*> removed;
+  for (auto iter = m_idToItem.begin(); iter != m_idToItem.end();) {
+    if (topology.indexOf(iter->first) != -1) {
+      ++iter;
+      continue;
+    }
+    FamilyMemberItem* item = iter->second;
+    removed.insert(item);
+    delete item->inArrow();
+    delete item;
+    iter = m_idToItem.erase(iter);
+  }
+  if (removed.empty()) {
+    return;
+  }
+  // A kept member whose parent went away, e.g. after a merge, gets a new arrow when it is laid out again.
+  for (const auto& pair : m_idToItem) {
+    FamilyMemberItem* item = pair.second;
+    if (item->inArrow() && removed.count(item->inArrow()->startItem())) {
+      delete item->inArrow();
+      item->setInArrow(nullptr);
+    }
+  }
 }
 
 void FamilyTreeScene::onTitleUpdated() {
   m_titleItem->setPlainText(m_family->title());
   FamilyMemberItem* rootItem = rootMemberItem();
-  Q_ASSERT(rootItem);
+  if (rootItem == nullptr) {
+    return;
+  }
   m_titleItem->setY(rootItem->y() - m_titleItem->boundingRect().height() - 40);
   m_titleItem->setX(rootItem->x() - (m_titleItem->boundingRect().width() - rootItem->width()) / 2);
 }
 
 void FamilyTreeScene::onTitleEditDone() {
   Q_ASSERT(m_family);
-  m_family->updateTitle(m_titleItem->toPlainText());
+  if (m_titleItem->toPlainText() != m_family->title()) {
+    emit titleEdited(m_titleItem->toPlainText());
+  }
 }
 
-void FamilyTreeScene::addMemberItem(FamilyMemberItem* item) {
-  Q_ASSERT(item && item->id() != "");
+void FamilyTreeScene::addMemberItem(FamilyMemberItem* item, FamilyMemberItem* parentItem) {
+  Q_ASSERT(item && !item->id().isNull());
   m_idToItem[item->id()] = item;
   addItem(item);
 
-  FamilyMemberItem* parentItem = parentMemberItem(item);
   if (parentItem == nullptr) {
     return;
   }
@@ -154,33 +333,34 @@ void FamilyTreeScene::addMemberItem(FamilyMemberItem* item) {
 
 FamilyMemberItem* FamilyTreeScene::rootMemberItem() {
   Q_ASSERT(m_family);
-  QString rootId = m_family->rootId();
-  return m_idToItem[rootId];
+  return getItem(m_family->rootId());
 }
 
 FamilyMemberItem* FamilyTreeScene::parentMemberItem(FamilyMemberItem* item) {
   Q_ASSERT(item);
-  QString id = item->id();
+  MemberId id = item->id();
   Q_ASSERT(m_family);
-  QString parentId = m_family->getParentId(id);
-  if (parentId == "") {
+  MemberId parentId = m_family->getParentId(id);
+  if (parentId.isNull()) {
     return nullptr;
   }
-  return m_idToItem[parentId];
+  return getItem(parentId);
 }
 
 std::vector<FamilyMemberItem*> FamilyTreeScene::childrenMemberItem(FamilyMemberItem* item) {
   Q_ASSERT(item);
-  QString id = item->id();
+  MemberId id = item->id();
   Q_ASSERT(m_family);
   FamilyMember member = m_family->getMember(id);
   Q_ASSERT(member.isValid());
-  std::vector<QString> children = member.children;
+  std::vector<MemberId> children = member.children;
   std::vector<FamilyMemberItem*> result;
-  for (const QString& child : children) {
-    Q_ASSERT(child != "");
-    FamilyMemberItem* childItem = m_idToItem[child];
-    Q_ASSERT(childItem);
+  for (const MemberId& child : children) {
+    Q_ASSERT(!child.isNull());
+    FamilyMemberItem* childItem = getItem(child);
+    if (childItem == nullptr) {
+      continue;
+    }
     result.push_back(childItem);
   }
   return result;
@@ -195,18 +375,13 @@ std::vector<FamilyMemberItem*> FamilyTreeScene::siblingsMemberItem(FamilyMemberI
   return childrenMemberItem(parentItem);
 }
 
-int FamilyTreeScene::indexInSiblings(FamilyMemberItem* item) {
-  Q_ASSERT(item);
-  std::vector<FamilyMemberItem*> siblings = siblingsMemberItem(item);
-  if (siblings.size() <= 1) {
-    return 0;
-  }
-  return std::find(siblings.begin(), siblings.end(), item) - siblings.begin();
-}
-
 void FamilyTreeScene::resetItems() {
   m_idToItem.clear();
+  m_rebuild = RebuildState();
+  m_rebuildTimer.stop();
+  m_drag = DragState();
   clear();
+  setSceneRect(QRectF());
 
   m_movingIndicator = new FamilyMemberItem(this, FamilyMember(true), nullptr, kActiveColor);
   m_movingIndicator->setOpacity(0.3);
@@ -240,54 +415,65 @@ void FamilyTreeScene::resetItems() {
 QMenu* FamilyTreeScene::itemMenu() const { return m_itemMenu; }
 
 void FamilyTreeScene::onItemDragBegin(FamilyMemberItem* item, QGraphicsSceneMouseEvent* event) {
+  Q_ASSERT(item);
+  Q_ASSERT(event);
   m_movingTargetNewIndex = -1;
-  m_movingBeginPos = event->pos();
+  m_drag = DragState();
+  m_drag.beginPos = event->pos();
+
+  FamilyMember member = m_family->getMember(item->id());
+  Q_ASSERT(member.isValid());
+  m_movingIndicator->update(member);
+
+  std::vector<FamilyMemberItem*> siblings = siblingsMemberItem(item);
+  if (siblings.size() <= 1) {
+    return;
+  }
+  m_drag.oldIndex = std::find(siblings.begin(), siblings.end(), item) - siblings.begin();
+  m_drag.y = siblings.front()->y();
+  for (const FamilyMemberItem* sibling : siblings) {
+    m_drag.siblingLefts.push_back(sibling->x());
+    m_drag.siblingRights.push_back(sibling->x() + sibling->width());
+  }
 }
 
 void FamilyTreeScene::onItemDragMoving(FamilyMemberItem* item, QGraphicsSceneMouseEvent* event) {
   m_movingTargetNewIndex = -1;
   Q_ASSERT(item);
   Q_ASSERT(event);
-  FamilyMember member = m_family->getMember(item->id());
-  Q_ASSERT(member.isValid());
-  m_movingIndicator->update(member);
-  m_movingIndicator->setPos(event->scenePos() - m_movingBeginPos);
+  m_movingIndicator->setPos(event->scenePos() - m_drag.beginPos);
   m_movingIndicator->setVisible(true);
 
-  std::vector<FamilyMemberItem*> siblings = siblingsMemberItem(item);
-  if (siblings.size() <= 1) {
+  const std::vector<qreal>& lefts = m_drag.siblingLefts;
+  const std::vector<qreal>& rights = m_drag.siblingRights;
+  if (lefts.size() <= 1) {
     return;
   }
 
-  int x = event->scenePos().x();
-  for (const FamilyMemberItem* sibling : siblings) {
-    if (x >= sibling->x() && x < (sibling->x() + sibling->width())) {
-      m_movingTargetIndicator->setVisible(false);
-      return;
-    }
+  qreal x = event->scenePos().x();
+  // Number of siblings starting at or before x, the cursor is either inside the last of them or in the gap after it.
+  int count = std::upper_bound(lefts.begin(), lefts.end(), x) - lefts.begin();
+  if (count > 0 && x < rights[count - 1]) {
+    m_movingTargetIndicator->setVisible(false);
+    return;
   }
 
-  m_movingTargetIndicator->setY(siblings.front()->y());
+  m_movingTargetIndicator->setY(m_drag.y);
 
-  int oldIndex = indexInSiblings(item);
-  if (x <= siblings.front()->x()) {
+  if (count == 0) {
     m_movingTargetNewIndex = 0;
-    m_movingTargetIndicator->setX(siblings.front()->x() - 15);
-  } else if (x > siblings.back()->x() + siblings.back()->width()) {
-    m_movingTargetNewIndex = siblings.size() - 1;
-    m_movingTargetIndicator->setX(siblings.back()->x() + siblings.back()->width() + 10);
+    m_movingTargetIndicator->setX(lefts.front() - 15);
+  } else if (count == static_cast<int>(lefts.size())) {
+    m_movingTargetNewIndex = lefts.size() - 1;
+    m_movingTargetIndicator->setX(rights.back() + 10);
   } else {
-    for (int i = 0; i < siblings.size() - 1; i++) {
-      if (x >= (siblings[i]->x() + siblings[i]->width()) && x < siblings[i + 1]->x()) {
-        m_movingTargetNewIndex = i + 1;
-        if (m_movingTargetNewIndex > oldIndex) {
-          m_movingTargetNewIndex--;
-        }
-        m_movingTargetIndicator->setX((siblings[i]->x() + siblings[i]->width() + siblings[i + 1]->x()) / 2 - 2.5);
-      }
+    m_movingTargetNewIndex = count;
+    if (m_movingTargetNewIndex > m_drag.oldIndex) {
+      m_movingTargetNewIndex--;
     }
+    m_movingTargetIndicator->setX((rights[count - 1] + lefts[count]) / 2 - 2.5);
   }
-  if (m_movingTargetNewIndex == oldIndex) {
+  if (m_movingTargetNewIndex == m_drag.oldIndex) {
     m_movingTargetNewIndex = -1;
   }
   m_movingTargetIndicator->setVisible(true);
@@ -301,19 +487,19 @@ void FamilyTreeScene::onItemDragDone(FamilyMemberItem* item, QGraphicsSceneMouse
     return;
   }
   Q_ASSERT(item);
-  QString id = item->id();
+  MemberId id = item->id();
   Q_ASSERT(m_family);
-  QString parentId = m_family->getParentId(id);
-  Q_ASSERT(parentId != "");
+  MemberId parentId = m_family->getParentId(id);
+  Q_ASSERT(!parentId.isNull());
   FamilyMember parent = m_family->getMember(parentId);
   Q_ASSERT(parent.isValid());
-  std::vector<QString> children = parent.children;
+  std::vector<MemberId> children = parent.children;
   Q_ASSERT(children.size() > 1);
   auto iter = std::find(children.begin(), children.end(), id);
   Q_ASSERT(iter != children.end());
   children.erase(iter);
   children.insert(children.begin() + m_movingTargetNewIndex, id);
-  m_family->reorderChildren(parentId, children);
+  emit childrenReordered(parentId, children);
 }
 
 void FamilyTreeScene::setFamily(Family* family) {
@@ -326,7 +512,7 @@ void FamilyTreeScene::setFamily(Family* family) {
   if (m_family) {
     Q_ASSERT(m_family->isValid());
     connect(m_family, &Family::titleUpdated, this, &FamilyTreeScene::onTitleUpdated);
-    connect(m_family, &Family::relayouted, this, &FamilyTreeScene::onRelayouted, Qt::QueuedConnection);
+    connect(m_family, &Family::relayouted, this, &FamilyTreeScene::onRelayouted);
     connect(m_family, &Family::memberUpdated, this, &FamilyTreeScene::onMemberUpdated);
     m_family->relayout();
   }
@@ -23,11 +23,16 @@
  ********************************************************************************/
 
 #include <QGraphicsScene>
+#include <QImage>
+#include <QTimer>
+
+#include "familymember.h"
 
 #pragma once
 
 class Family;
 class FamilyMemberItem;
+struct MemoryReport;
 class FamilyTitleItem;
 class QMenu;
 class FamilyTreeScene : public QGraphicsScene {
@@ -38,42 +43,80 @@ class FamilyTreeScene : public QGraphicsScene {
 
   void setFamily(Family* family);
 
-  FamilyMemberItem* getItem(const QString& id);
-  QString selectedMemberId() const;
+  FamilyMemberItem* getItem(const MemberId& id);
+  MemberId selectedMemberId() const;
+  std::vector<MemberId> selectedMemberIds() const;
+  FamilyMemberItem* selectMember(const MemberId& id);
 
   QMenu* itemMenu() const;
 
+  void flushRebuild();
+  // The given part of the scene with a white border, what File > Export writes. Null when too large for a QImage.
+  QImage renderImage(const QRectF& sourceRect);
+  void reportMemory(MemoryReport& report) const;
+
   void onItemDragBegin(FamilyMemberItem* item, QGraphicsSceneMouseEvent* event);
   void onItemDragMoving(FamilyMemberItem* item, QGraphicsSceneMouseEvent* event);
   void onItemDragDone(FamilyMemberItem* item, QGraphicsSceneMouseEvent* event);
 
  signals:
   void itemDoubleClicked(FamilyMemberItem* item);
+  void rebuildProgress(int built, int total);
+  // Edits made on the scene, applied by the owner of the undo stack.
+  void titleEdited(const QString& title);
+  void childrenReordered(const MemberId& parentId, const std::vector<MemberId>& children);
 
  private:
-  void onMemberUpdated(const QString& id);
+  void onMemberUpdated(const MemberId& id);
   void onRelayouted();
+  void onRebuildTimeout();
+  bool rebuildStep();
+  void layoutMember(int index);
+  // Creates or moves the items from the root down to index, without the rest of the tree.
+  FamilyMemberItem* buildPath(int index);
+  // Places the member offsetInParent into its parent's subtree and returns the width of its own subtree.
+  qreal placeMember(int index, qreal offsetInParent);
   void onTitleUpdated();
 
   void onTitleEditDone();
 
-  void addMemberItem(FamilyMemberItem* item);
+  void addMemberItem(FamilyMemberItem* item, FamilyMemberItem* parentItem);
 
   FamilyMemberItem* rootMemberItem();
   FamilyMemberItem* parentMemberItem(FamilyMemberItem* item);
   std::vector<FamilyMemberItem*> childrenMemberItem(FamilyMemberItem* item);
   std::vector<FamilyMemberItem*> siblingsMemberItem(FamilyMemberItem* item);
-  int indexInSiblings(FamilyMemberItem* item);
 
   void resetItems();
+  void removeStaleItems();
 
  private:
   QMenu* m_itemMenu = nullptr;
   Family* m_family = nullptr;
-  std::map<QString, FamilyMemberItem*> m_idToItem;
-  QPointF m_movingBeginPos;
+  std::map<MemberId, FamilyMemberItem*> m_idToItem;
   FamilyTitleItem* m_titleItem = nullptr;
   FamilyMemberItem* m_movingIndicator = nullptr;
   QGraphicsPathItem* m_movingTargetIndicator = nullptr;
   int m_movingTargetNewIndex = -1;
+
+  struct DragState {
+    QPointF beginPos;
+    int oldIndex = 0;
+    qreal y = 0;
+    std::vector<qreal> siblingLefts;
+    std::vector<qreal> siblingRights;
+  };
+  DragState m_drag;
+
+  struct RebuildState {
+    bool pending = false;
+    // Position in the breadth-first order of Family::topology().
+    int index = 0;
+    int curParent = -1;
+    qreal layoutedChildrenWidth = 0;
+    // Time spent in earlier slices of this build.
+    qint64 elapsedNs = 0;
+  };
+  RebuildState m_rebuild;
+  QTimer m_rebuildTimer;
 };
@@ -24,7 +24,17 @@
 
 #include "familytreeview.h"
 
+#include <QPainter>
 #include <QWheelEvent>
+#include <algorithm>
+
+#include "perfstats.h"
+#include "trace.h"
+
+static constexpr int kHudSampleIntervalMs = 500;
+static constexpr qreal kHudHistogramMaxMs = 33.3;
+// Paints further apart than this are separate updates rather than an animation or a drag, their gap is no frame time.
+static constexpr qint64 kContinuousPaintGapNs = 100 * 1000 * 1000;
 
 FamilyTreeView::FamilyTreeView(QWidget* parent) : QGraphicsView(parent) {
   setMouseTracking(true);
@@ -53,3 +63,103 @@ void FamilyTreeView::mouseMoveEvent(QMouseEvent* event) {
   setFocus();
   QGraphicsView::mouseMoveEvent(event);
 }
+
+void FamilyTreeView::setHudVisible(bool visible) {
+  if (m_isHudVisible == visible) {
+    return;
+  }
+  m_isHudVisible = visible;
+  // The overlay is fixed to the viewport, scrolled or partial repaints would smear it.
+  if (visible) {
+    m_updateModeBeforeHud = viewportUpdateMode();
+    setViewportUpdateMode(FullViewportUpdate);
+    m_sampleTimer.invalidate();
+  } else {
+    setViewportUpdateMode(m_updateModeBeforeHud);
+  }
+  viewport()->update();
+}
+
+void FamilyTreeView::paintEvent(QPaintEvent* event) {
+  TRACE_SCOPE("FamilyTreeView::paint");
+  if (!m_isHudVisible) {
+    QGraphicsView::paintEvent(event);
+    return;
+  }
+  if (m_frameTimer.isValid()) {
+    qint64 gapNs = m_frameTimer.nsecsElapsed();
+    m_frameNs = gapNs <= kContinuousPaintGapNs ? gapNs : 0;
+  }
+  m_frameTimer.start();
+  QElapsedTimer timer;
+  timer.start();
+  QGraphicsView::paintEvent(event);
+  m_paintNs[m_paintCount++ % kPaintHistorySize] = timer.nsecsElapsed();
+}
+
+void FamilyTreeView::drawForeground(QPainter* painter, const QRectF& rect) {
+  QGraphicsView::drawForeground(painter, rect);
+  if (!m_isHudVisible) {
+    return;
+  }
+  sampleHudCounters();
+
+  int sampleCount = std::min(m_paintCount, kPaintHistorySize);
+  qint64 maxPaintNs = 0;
+  qint64 totalPaintNs = 0;
+  for (int i = 0; i < sampleCount; i++) {
+    maxPaintNs = std::max(maxPaintNs, m_paintNs[i]);
+    totalPaintNs += m_paintNs[i];
+  }
+  auto ms = [](qint64 ns) { return QString::number(ns / 1e6, 'f', 1); };
+  QStringList lines;
+  if (m_frameNs > 0) {
+    lines << QString("Frame: %1 ms (%2 fps)").arg(ms(m_frameNs)).arg(qRound(1e9 / m_frameNs));
+  } else {
+    lines << QString("Frame: idle");
+  }
+  lines << QString("Paint: avg %1 / max %2 ms").arg(ms(sampleCount ? totalPaintNs / sampleCount : 0), ms(maxPaintNs));
+  lines << QString("Items: %1 visible / %2").arg(m_visibleItemCount).arg(m_totalItemCount);
+  lines << QString("Relayout: %1 ms").arg(ms(PerfStats::relayoutNs));
+  lines << QString("Scene rebuild: %1 ms").arg(ms(PerfStats::sceneRebuildNs));
+  lines << QString("Memory: %1").arg(m_residentMemory < 0 ? "n/a" : QString("%1 MB").arg(m_residentMemory >> 20));
+
+  constexpr int kPadding = 8;
+  constexpr int kLineHeight = 16;
+  constexpr int kHistogramHeight = 40;
+  constexpr int kBarWidth = 3;
+  painter->save();
+  painter->resetTransform();
+  painter->setFont(QFont("monospace", 9));
+  QRect box(kPadding, kPadding, kPaintHistorySize * kBarWidth + kPadding * 2,
+            lines.size() * kLineHeight + kHistogramHeight + kPadding * 3);
+  painter->setPen(Qt::NoPen);
+  painter->setBrush(QColor(0, 0, 0, 180));
+  painter->drawRect(box);
+  painter->setPen(Qt::white);
+  for (int i = 0; i < lines.size(); i++) {
+    painter->drawText(box.left() + kPadding, box.top() + kPadding + (i + 1) * kLineHeight - 4, lines[i]);
+  }
+
+  // Paint times, oldest on the left, full height is two frames at 60 Hz.
+  int histogramBottom = box.bottom() - kPadding;
+  for (int i = 0; i < sampleCount; i++) {
+    qint64 ns = m_paintNs[(m_paintCount - sampleCount + i) % kPaintHistorySize];
+    int height = std::min<qreal>(ns / 1e6 / kHudHistogramMaxMs, 1.0) * kHistogramHeight;
+    painter->fillRect(box.left() + kPadding + i * kBarWidth, histogramBottom - height, kBarWidth - 1, height,
+                      ns > 16.7e6 ? QColor(0xff, 0x60, 0x60) : QColor(0x60, 0xd0, 0x60));
+  }
+  painter->restore();
+}
+
+void FamilyTreeView::sampleHudCounters() {
+  if (m_sampleTimer.isValid() && m_sampleTimer.elapsed() < kHudSampleIntervalMs) {
+    return;
+  }
+  m_sampleTimer.start();
+  if (scene()) {
+    m_visibleItemCount = scene()->items(mapToScene(viewport()->rect()).boundingRect()).size();
+    m_totalItemCount = scene()->items().size();
+  }
+  m_residentMemory = PerfStats::residentMemory();
+}
@@ -22,7 +22,9 @@
  * SOFTWARE.
  ********************************************************************************/
 
+#include <QElapsedTimer>
 #include <QGraphicsView>
+#include <array>
 
 #pragma once
 
@@ -30,10 +32,32 @@ class FamilyTreeView : public QGraphicsView {
  public:
   explicit FamilyTreeView(QWidget* parent = nullptr);
 
+  bool isHudVisible() const { return m_isHudVisible; }
+  void setHudVisible(bool visible);
+
  protected:
   void wheelEvent(QWheelEvent* event) override;
   void mouseMoveEvent(QMouseEvent* event) override;
+  void paintEvent(QPaintEvent* event) override;
+  void drawForeground(QPainter* painter, const QRectF& rect) override;
+
+ private:
+  void sampleHudCounters();
 
  private:
   qreal m_scale = 1.0;
+
+  bool m_isHudVisible = false;
+  ViewportUpdateMode m_updateModeBeforeHud = MinimalViewportUpdate;
+  static constexpr int kPaintHistorySize = 60;
+  std::array<qint64, kPaintHistorySize> m_paintNs = {};
+  int m_paintCount = 0;
+  // Gap between the last two paints while painting continuously, 0 when idle.
+  QElapsedTimer m_frameTimer;
+  qint64 m_frameNs = 0;
+  // Counters that need a scene query or a syscall are refreshed at most a few times per second.
+  QElapsedTimer m_sampleTimer;
+  int m_visibleItemCount = 0;
+  int m_totalItemCount = 0;
+  qint64 m_residentMemory = -1;
 };
@@ -0,0 +1,169 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "familyvalidator.h"
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+static constexpr size_t kChunkSize = 4096;
+
+using MemberIndex = std::unordered_map<MemberId, const FamilyMember*, MemberIdHash>;
+
+static void checkMember(const FamilyMember& member, const MemberId& rootId, const MemberIndex& index,
+                        std::vector<FamilyValidator::Problem>& problems) {
+  if (member.id == rootId && !member.parentId.isNull()) {
+    problems.push_back({member.id, QString("root has parent %1").arg(memberIdToString(member.parentId))});
+  }
+  for (size_t i = 0; i < member.children.size(); i++) {
+    const MemberId& childId = member.children[i];
+    auto iter = index.find(childId);
+    if (iter == index.end()) {
+      problems.push_back({member.id, QString("child %1 does not exist").arg(memberIdToString(childId))});
+      continue;
+    }
+    const FamilyMember& child = *iter->second;
+    if (child.parentId != member.id) {
+      QString message = QString("parentId is %1, but listed as child of %2")
+                            .arg(memberIdToString(child.parentId), memberIdToString(member.id));
+      problems.push_back({childId, message});
+    } else if (child.indexAsChild != static_cast<int>(i)) {
+      problems.push_back({childId, QString("indexAsChild is %1, expected %2").arg(child.indexAsChild).arg(i)});
+    }
+  }
+  if (member.parentId.isNull()) {
+    return;
+  }
+  auto iter = index.find(member.parentId);
+  if (iter == index.end()) {
+    problems.push_back({member.id, QString("parent %1 does not exist").arg(memberIdToString(member.parentId))});
+    return;
+  }
+  const std::vector<MemberId>& siblings = iter->second->children;
+  if (std::find(siblings.begin(), siblings.end(), member.id) == siblings.end()) {
+    QString message = QString("not listed in children of parent %1").arg(memberIdToString(member.parentId));
+    problems.push_back({member.id, message});
+  }
+}
+
+std::vector<FamilyValidator::Problem> FamilyValidator::validate(const MemberId& rootId,
+                                                                const std::map<MemberId, FamilyMember>& members) {
+  std::vector<const FamilyMember*> list;
+  MemberIndex index;
+  list.reserve(members.size());
+  index.reserve(members.size());
+  for (const auto& pair : members) {
+    list.push_back(&pair.second);
+    index[pair.first] = &pair.second;
+  }
+
+  std::vector<int> chunks((list.size() + kChunkSize - 1) / kChunkSize);
+  std::vector<std::vector<Problem>> chunkProblems(chunks.size());
+  for (size_t i = 0; i < chunks.size(); i++) {
+    chunks[i] = i;
+  }
+  QtConcurrent::blockingMap(chunks, [&](int& chunk) {
+    size_t end = std::min(list.size(), (chunk + 1) * kChunkSize);
+    for (size_t i = chunk * kChunkSize; i < end; i++) {
+      checkMember(*list[i], rootId, index, chunkProblems[chunk]);
+    }
+  });
+
+  std::vector<Problem> result;
+  for (std::vector<Problem>& problems : chunkProblems) {
+    result.insert(result.end(), problems.begin(), problems.end());
+  }
+
+  if (!index.count(rootId)) {
+    result.push_back({rootId, "root does not exist"});
+    return result;
+  }
+
+  // A member reached twice is either listed by several parents or part of a cycle through the root.
+  std::unordered_set<MemberId, MemberIdHash> visited({rootId});
+  std::vector<const FamilyMember*> queue({index[rootId]});
+  for (size_t i = 0; i < queue.size(); i++) {
+    for (const MemberId& childId : queue[i]->children) {
+      auto iter = index.find(childId);
+      if (iter == index.end()) {
+        continue;
+      }
+      if (!visited.insert(childId).second) {
+        QString message =
+            QString("reached again from %1, duplicate child or cycle").arg(memberIdToString(queue[i]->id));
+        result.push_back({childId, message});
+        continue;
+      }
+      queue.push_back(iter->second);
+    }
+  }
+  if (visited.size() < list.size()) {
+    for (const FamilyMember* member : list) {
+      if (!visited.count(member->id)) {
+        result.push_back({member->id, "not reachable from root, orphan or cycle"});
+      }
+    }
+  }
+  return result;
+}
+
+int FamilyValidator::repair(const MemberId& rootId, std::map<MemberId, FamilyMember>& members) {
+  auto root = members.find(rootId);
+  if (root == members.end()) {
+    return 0;
+  }
+  int result = 0;
+  if (!root->second.parentId.isNull() || root->second.indexAsChild != 0) {
+    root->second.parentId = MemberId();
+    root->second.indexAsChild = 0;
+    result++;
+  }
+
+  std::unordered_set<MemberId, MemberIdHash> visited({rootId});
+  std::vector<FamilyMember*> queue({&root->second});
+  for (size_t i = 0; i < queue.size(); i++) {
+    FamilyMember& member = *queue[i];
+    std::vector<MemberId> children;
+    for (const MemberId& childId : member.children) {
+      auto iter = members.find(childId);
+      if (iter == members.end() || !visited.insert(childId).second) {
+        result++;
+        continue;
+      }
+      FamilyMember& child = iter->second;
+      int indexAsChild = children.size();
+      if (child.parentId != member.id || child.indexAsChild != indexAsChild) {
+        child.parentId = member.id;
+        child.indexAsChild = indexAsChild;
+        result++;
+      }
+      children.push_back(childId);
+      queue.push_back(&child);
+    }
+    member.children.swap(children);
+  }
+  return result;
+}
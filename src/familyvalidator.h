@@ -0,0 +1,47 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <map>
+#include <vector>
+
+#include "familymember.h"
+
+// Consistency checks for members read from a file. Per-member checks run in parallel over chunks, the reachability
+// pass from the root is a single linear walk.
+class FamilyValidator {
+ public:
+  struct Problem {
+    MemberId id;
+    QString message;
+  };
+
+  static std::vector<Problem> validate(const MemberId& rootId, const std::map<MemberId, FamilyMember>& members);
+
+  // Rewrites the derived fields (parentId, indexAsChild) from the children lists and drops child references that are
+  // dangling or would make a member reachable twice. Orphans are left in place. Returns the number of fixes.
+  static int repair(const MemberId& rootId, std::map<MemberId, FamilyMember>& members);
+};
@@ -23,15 +23,54 @@
  ********************************************************************************/
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
 
 #include "mainwindow.h"
+#include "memoryreport.h"
+#include "trace.h"
+
+// Loads the file, builds the full scene without showing it and prints the per-subsystem estimate. Needs a display
+// or "-platform offscreen" for the text items.
+static int printMemoryReport(const QString& path) {
+  std::unique_ptr<Family> family(Family::load(path));
+  if (!family) {
+    qWarning() << "can't load" << path;
+    return 1;
+  }
+  family->relayout();
+  FamilyTreeScene scene(nullptr);
+  scene.setFamily(family.get());
+  scene.flushRebuild();
+  QTextStream(stdout) << MemoryReport::collect(family.get(), &scene).toText() << "\n";
+  scene.setFamily(nullptr);
+  return 0;
+}
 
 int main(int argc, char* argv[]) {
   qSetMessagePattern("%{time yyyy-MM-dd h:mm:ss.zzz} [%{type}] (%{file}:%{line}) %{function} - %{message}");
 
+  // FAMILY_TREE_TRACE=trace.json records spans and writes them on exit.
+  QString tracePath = qEnvironmentVariable("FAMILY_TREE_TRACE");
+  Trace::setEnabled(tracePath != "");
+
   QApplication a(argc, argv);
   a.setWindowIcon(QIcon(":/resources/family_tree.svg"));
+
+  QCommandLineParser parser;
+  parser.addHelpOption();
+  QCommandLineOption memoryReportOption("memory-report", "Print the memory use of <file> and exit.", "file");
+  parser.addOption(memoryReportOption);
+  parser.process(a);
+  if (parser.isSet(memoryReportOption)) {
+    return printMemoryReport(parser.value(memoryReportOption));
+  }
+
   MainWindow w;
   w.show();
-  return a.exec();
+  int result = a.exec();
+  if (tracePath != "") {
+    Trace::dump(tracePath);
+  }
+  return result;
 }
@@ -25,10 +25,25 @@
 #include "mainwindow.h"
 
 #include <QCloseEvent>
+#include <QDialogButtonBox>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QInputDialog>
 #include <QMessageBox>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QShortcut>
+#include <QTimer>
+#include <QToolBar>
+#include <QVBoxLayout>
+#include <unordered_set>
 
+#include "familycommands.h"
+#include "familydiff.h"
+#include "familymemberitem.h"
 #include "familytreescene.h"
+#include "memoryreport.h"
+#include "trace.h"
 #include "ui_mainwindow.h"
 
 MainWindow::MainWindow(QWidget* parent)
@@ -37,6 +52,12 @@ MainWindow::MainWindow(QWidget* parent)
       m_memberEditDialog(new FamilyMemberEditDialog),
       m_itemMenu(new QMenu(this)),
       m_addChildAction(new QAction(this)),
+      m_cutAction(new QAction(tr("Cut branch"), this)),
+      m_copyAction(new QAction(tr("Copy branch"), this)),
+      m_pasteAction(new QAction(tr("Paste as child"), this)),
+      m_deleteBranchAction(new QAction(tr("Delete branch"), this)),
+      m_undoStack(new QUndoStack(this)),
+      m_searchEdit(new QLineEdit(this)),
       m_scene(new FamilyTreeScene(m_itemMenu, this)) {
   ui->setupUi(this);
   ui->graphicsView->setScene(m_scene);
@@ -44,19 +65,69 @@ MainWindow::MainWindow(QWidget* parent)
 
   m_addChildAction->setText("Add child");
   m_itemMenu->addAction(m_addChildAction);
+  m_itemMenu->addSeparator();
+  m_cutAction->setShortcut(QKeySequence::Cut);
+  m_copyAction->setShortcut(QKeySequence::Copy);
+  m_pasteAction->setShortcut(QKeySequence::Paste);
+  m_deleteBranchAction->setShortcut(QKeySequence::Delete);
+  for (QAction* action : {m_cutAction, m_copyAction, m_pasteAction, m_deleteBranchAction}) {
+    m_itemMenu->addAction(action);
+  }
+
+  QAction* undoAction = m_undoStack->createUndoAction(this);
+  undoAction->setShortcut(QKeySequence::Undo);
+  QAction* redoAction = m_undoStack->createRedoAction(this);
+  redoAction->setShortcut(QKeySequence::Redo);
+  ui->menuEdit->addAction(undoAction);
+  ui->menuEdit->addAction(redoAction);
+  ui->menuEdit->addSeparator();
+  ui->menuEdit->addActions({m_cutAction, m_copyAction, m_pasteAction, m_deleteBranchAction});
+
+  m_searchEdit->setPlaceholderText(tr("Search"));
+  m_searchEdit->setClearButtonEnabled(true);
+  m_searchEdit->setMaximumWidth(300);
+  addToolBar(tr("Search"))->addWidget(m_searchEdit);
+  connect(m_searchEdit, &QLineEdit::returnPressed, this, &MainWindow::onSearch);
+  connect(new QShortcut(QKeySequence::Find, this), &QShortcut::activated, this, [this]() {
+    m_searchEdit->setFocus();
+    m_searchEdit->selectAll();
+  });
 
   connect(m_addChildAction, &QAction::triggered, this, &MainWindow::onAddChild);
+  connect(m_cutAction, &QAction::triggered, this, &MainWindow::onCut);
+  connect(m_copyAction, &QAction::triggered, this, &MainWindow::onCopy);
+  connect(m_pasteAction, &QAction::triggered, this, &MainWindow::onPaste);
+  connect(m_deleteBranchAction, &QAction::triggered, this, &MainWindow::onDeleteBranch);
   connect(ui->actionLoad, &QAction::triggered, this, &MainWindow::onLoad);
   connect(ui->actionSave, &QAction::triggered, this, &MainWindow::onSave);
   connect(ui->actionExport, &QAction::triggered, this, &MainWindow::onExport);
+  connect(ui->actionExportGeneration, &QAction::triggered, this, &MainWindow::onExportGeneration);
+  connect(ui->actionMerge, &QAction::triggered, this, &MainWindow::onMerge);
+  connect(ui->actionGoToGeneration, &QAction::triggered, this, &MainWindow::onGoToGeneration);
+  connect(ui->actionPerformanceHud, &QAction::toggled, ui->graphicsView, &FamilyTreeView::setHudVisible);
+  connect(ui->actionMemoryReport, &QAction::triggered, this, &MainWindow::onMemoryReport);
   connect(m_scene, &FamilyTreeScene::itemDoubleClicked, this, &MainWindow::onEdit);
+  connect(m_scene, &FamilyTreeScene::rebuildProgress, this, &MainWindow::onRebuildProgress);
+  connect(m_scene, &QGraphicsScene::selectionChanged, this, &MainWindow::onSelectionChanged);
+  connect(m_scene, &FamilyTreeScene::titleEdited, this, [this](const QString& title) {
+    m_undoStack->push(new UpdateTitleCommand(m_family.get(), title));
+  });
+  connect(m_scene, &FamilyTreeScene::childrenReordered, this,
+          [this](const MemberId& parentId, const std::vector<MemberId>& children) {
+            m_undoStack->push(new ReorderChildrenCommand(m_family.get(), parentId, children));
+          });
 
   connect(this, &MainWindow::currentFilePathChanged, this, &MainWindow::updateWindowTitle);
 
+  m_autosave = new FamilyAutosave(this);
   doLoad("", new Family);
+  QTimer::singleShot(0, this, &MainWindow::offerRecovery);
 }
 
-MainWindow::~MainWindow() { delete ui; }
+MainWindow::~MainWindow() {
+  m_autosave->discard();
+  delete ui;
+}
 
 void MainWindow::onLoad(bool bypassPromptSave) {
   qDebug() << bypassPromptSave;
@@ -71,24 +142,42 @@ void MainWindow::onLoad(bool bypassPromptSave) {
     }
     return;
   }
-  QString path = QFileDialog::getOpenFileName(this, tr("Load"), "", tr("*.json"));
+  QString path = QFileDialog::getOpenFileName(this, tr("Load"), "", tr("Family (*.json *.jsonz)"));
   qDebug() << path;
   if (path == "") {
     return;
   }
-  QFile file(path);
-  bool ret = file.open(QFile::ReadOnly);
-  Q_ASSERT(ret);
-  if (!ret) {
-    return;
-  }
-  QString json = file.readAll();
-  Family* family = Family::fromJson(json);
+  Family* family = Family::load(path);
   if (!family || !family->isValid()) {
-    qDebug().noquote() << "not valid:" << json;
+    qDebug() << "not valid:" << path;
+    delete family;
+    QMessageBox::warning(this, tr("Load"), tr("Can't open %1, it is damaged or from a newer version.").arg(path));
     return;
   }
 
+  std::vector<FamilyValidator::Problem> problems = family->validate();
+  if (!problems.empty()) {
+    constexpr size_t kMaxShownProblems = 20;
+    QStringList lines;
+    for (const FamilyValidator::Problem& problem : problems) {
+      qDebug() << problem.id << problem.message;
+      if (lines.size() < static_cast<int>(kMaxShownProblems)) {
+        lines.push_back(QString("%1: %2").arg(problem.id.toString(), problem.message));
+      }
+    }
+    QMessageBox::StandardButton button =
+        QMessageBox::warning(this, tr("Invalid file"),
+                             tr("%1 problem(s) found:\n%2\n\nRepair parent links and child indexes, then open?")
+                                 .arg(problems.size())
+                                 .arg(lines.join("\n")),
+                             QMessageBox::Yes | QMessageBox::Cancel, QMessageBox::Yes);
+    if (button != QMessageBox::Yes) {
+      delete family;
+      return;
+    }
+    qDebug() << "repaired:" << family->repair();
+  }
+
   doLoad(path, family);
 }
 
@@ -97,7 +186,7 @@ void MainWindow::onSave() {
   Q_ASSERT(m_family && m_family->isValid());
   QString path = m_currentFilePath;
   if (path == "") {
-    path = QFileDialog::getSaveFileName(this, tr("Save"), "", tr("*.json"));
+    path = QFileDialog::getSaveFileName(this, tr("Save"), "", tr("Family (*.json);;Compressed family (*.jsonz)"));
   }
   if (path == "") {
     return;
@@ -114,34 +203,309 @@ void MainWindow::onExport() {
     return;
   }
 
-  constexpr int kPadding = 30;
-  constexpr int kMargin = 20;
-  QRectF sceneRect = m_scene->sceneRect();
-  QImage image(sceneRect.width() + (kPadding + kMargin) * 2, sceneRect.height() + (kPadding + kMargin) * 2,
-               QImage::Format_ARGB32);
-  image.fill(Qt::white);
-  QPainter painter(&image);
-  m_scene->render(&painter, QRectF(QPointF(kPadding + kMargin, kPadding + kMargin), sceneRect.size()));
-  painter.drawRect(kMargin, kMargin, sceneRect.width() + kPadding * 2, sceneRect.height() + kPadding * 2);
-  bool ret = image.save(path);
+  m_scene->flushRebuild();
+  exportImage(path, m_scene->sceneRect());
+}
+
+void MainWindow::onExportGeneration() {
+  qDebug() << "";
+  Q_ASSERT(m_family && m_family->isValid());
+  int layer = askGeneration(tr("Export Generation"));
+  if (layer < 0) {
+    return;
+  }
+  QString path = QFileDialog::getSaveFileName(this, tr("Export"), "", tr("*.png"));
+  qDebug() << "path:" << path;
+  if (path == "") {
+    return;
+  }
+
+  m_scene->flushRebuild();
+  QRectF sourceRect;
+  for (const MemberId& id : m_family->topology().generation(layer)) {
+    FamilyMemberItem* item = m_scene->getItem(id);
+    if (item) {
+      sourceRect |= item->sceneBoundingRect();
+    }
+  }
+  exportImage(path, sourceRect);
+}
+
+void MainWindow::onMerge() {
+  Q_ASSERT(m_family && m_family->isValid());
+  QString basePath = QFileDialog::getOpenFileName(this, tr("Merge: common base"), "", tr("Family (*.json *.jsonz)"));
+  if (basePath == "") {
+    return;
+  }
+  QString theirsPath = QFileDialog::getOpenFileName(this, tr("Merge: other copy"), "", tr("Family (*.json *.jsonz)"));
+  if (theirsPath == "") {
+    return;
+  }
+  std::unique_ptr<Family> base(Family::load(basePath));
+  std::unique_ptr<Family> theirs(Family::load(theirsPath));
+  if (!base || !base->isValid() || !theirs || !theirs->isValid()) {
+    QMessageBox::warning(this, tr("Merge"), tr("Can't load %1 or %2.").arg(basePath, theirsPath));
+    return;
+  }
+  FamilyDiff::Merge merge = FamilyDiff::merge(*base, *m_family, *theirs);
+
+  int counts[3] = {0, 0, 0};
+  for (const FamilyDiff::Change& change : merge.changes) {
+    counts[change.kind]++;
+  }
+  QString text = tr("%1 added, %2 removed, %3 changed, %4 conflict(s).\n\nApply the merge?")
+                     .arg(counts[FamilyDiff::Change::Added])
+                     .arg(counts[FamilyDiff::Change::Removed])
+                     .arg(counts[FamilyDiff::Change::Modified])
+                     .arg(merge.conflicts.size());
+  QMessageBox box(QMessageBox::Question, tr("Merge"), text, QMessageBox::Yes | QMessageBox::Cancel, this);
+  if (!merge.conflicts.empty()) {
+    constexpr size_t kMaxShownConflicts = 1000;
+    QStringList lines;
+    for (const FamilyDiff::Conflict& conflict : merge.conflicts) {
+      if (lines.size() == static_cast<int>(kMaxShownConflicts)) {
+        lines.push_back("...");
+        break;
+      }
+      auto iter = merge.members.find(conflict.id);
+      QString name = iter == merge.members.end() ? conflict.id.toString() : iter->second.name;
+      lines.push_back(QString("%1: %2").arg(name, conflict.message));
+    }
+    box.setDetailedText(lines.join("\n"));
+  }
+  if (box.exec() != QMessageBox::Yes) {
+    return;
+  }
+  m_undoStack->push(new ReplaceMembersCommand(m_family.get(), merge.title, merge.members,
+                                              tr("Merge %1").arg(QFileInfo(theirsPath).fileName())));
+}
+
+void MainWindow::onGoToGeneration() {
+  Q_ASSERT(m_family && m_family->isValid());
+  int layer = askGeneration(tr("Go to Generation"));
+  if (layer < 0) {
+    return;
+  }
+  FamilyTopology::IdRange generation = m_family->topology().generation(layer);
+  Q_ASSERT(generation.size() > 0);
+  FamilyMemberItem* item = m_scene->selectMember(*generation.begin());
+  if (item == nullptr) {
+    return;
+  }
+  ui->graphicsView->centerOn(item);
+  ui->statusbar->showMessage(tr("Generation %1: %2 member(s)").arg(layer + 1).arg(generation.size()), 3000);
+}
+
+void MainWindow::onMemoryReport() {
+  QDialog dialog(this);
+  dialog.setWindowTitle(tr("Memory Report"));
+  dialog.resize(560, 420);
+  QPlainTextEdit* text = new QPlainTextEdit(&dialog);
+  text->setReadOnly(true);
+  text->setFont(QFont("monospace"));
+  QDialogButtonBox* buttons = new QDialogButtonBox(QDialogButtonBox::Close, &dialog);
+  QPushButton* refreshButton = buttons->addButton(tr("Refresh"), QDialogButtonBox::ActionRole);
+  QVBoxLayout* layout = new QVBoxLayout(&dialog);
+  layout->addWidget(text);
+  layout->addWidget(buttons);
+
+  auto refresh = [this, text]() {
+    m_scene->flushRebuild();
+    text->setPlainText(MemoryReport::collect(m_family.get(), m_scene).toText());
+  };
+  connect(refreshButton, &QPushButton::clicked, &dialog, refresh);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  refresh();
+  dialog.exec();
+}
+
+int MainWindow::askGeneration(const QString& title) {
+  bool ok = false;
+  int generation = QInputDialog::getInt(this, title, tr("Generation:"), 1, 1, m_family->layerCount(), 1, &ok);
+  return ok ? generation - 1 : -1;
+}
+
+void MainWindow::exportImage(const QString& path, const QRectF& sourceRect) {
+  TRACE_SCOPE("MainWindow::exportImage");
+  QImage image = m_scene->renderImage(sourceRect);
+  bool ret = !image.isNull() && image.save(path);
   qDebug() << "save image return:" << ret;
 }
 
 void MainWindow::onAddChild() {
   qDebug() << "";
-  QString parentId = m_scene->selectedMemberId();
-  Q_ASSERT(parentId != "");
-  m_memberEditDialog->show("Add", FamilyMember(true),
-                           [this, parentId](const FamilyMember& member) { m_family->addChild(parentId, member); });
+  MemberId parentId = m_scene->selectedMemberId();
+  if (!m_family->members().count(parentId)) {
+    return;
+  }
+  m_memberEditDialog->show("Add", FamilyMember(true), [this, parentId](const FamilyMember& member) {
+    // The dialog is not modal, the parent may be gone by now.
+    if (m_family->members().count(parentId)) {
+      m_undoStack->push(new AddChildCommand(m_family.get(), parentId, member));
+    }
+  });
 }
 
 void MainWindow::onEdit() {
   qDebug() << "";
-  QString id = m_scene->selectedMemberId();
-  Q_ASSERT(id != "");
+  MemberId id = m_scene->selectedMemberId();
+  FamilyMember member = m_family->getMember(id);
+  if (!member.isValid()) {
+    return;
+  }
+  member.note = m_family->fullNote(id);
+  member.noteOffset = -1;
+  member.noteSize = 0;
+  m_memberEditDialog->show("Edit", member, [this](const FamilyMember& member) {
+    if (m_family->members().count(member.id)) {
+      m_undoStack->push(new UpdateMemberCommand(m_family.get(), member));
+    }
+  });
+}
+
+void MainWindow::onCut() {
+  MemberId id = m_scene->selectedMemberId();
   FamilyMember member = m_family->getMember(id);
-  Q_ASSERT(member.isValid());
-  m_memberEditDialog->show("Edit", member, [this](const FamilyMember& member) { m_family->updateMember(member); });
+  if (!member.isValid() || id == m_family->rootId()) {
+    return;
+  }
+  m_cutId = id;
+  m_clipboard.clear();
+  ui->statusbar->showMessage(tr("Cut %1, paste onto the new parent to move it").arg(member.name), 3000);
+}
+
+void MainWindow::onCopy() {
+  MemberId id = m_scene->selectedMemberId();
+  if (id.isNull()) {
+    return;
+  }
+  m_cutId = MemberId();
+  m_clipboard = m_family->copySubtree(id);
+  ui->statusbar->showMessage(tr("Copied %1 member(s)").arg(m_clipboard.size()), 3000);
+}
+
+void MainWindow::onPaste() {
+  MemberId parentId = m_scene->selectedMemberId();
+  if (!m_family->members().count(parentId)) {
+    return;
+  }
+  if (!m_cutId.isNull()) {
+    if (!m_family->members().count(m_cutId)) {
+      m_cutId = MemberId();
+      ui->statusbar->showMessage(tr("The cut branch has been deleted"), 3000);
+      return;
+    }
+    if (!m_family->canMoveSubtree(m_cutId, parentId)) {
+      ui->statusbar->showMessage(tr("Can't move a branch into itself"), 3000);
+      return;
+    }
+    m_undoStack->push(new MoveSubtreeCommand(m_family.get(), m_cutId, parentId));
+    m_cutId = MemberId();
+    return;
+  }
+  if (m_clipboard.empty()) {
+    return;
+  }
+  std::vector<FamilyMember> members = m_clipboard;
+  Family::remapIds(members);
+  m_undoStack->push(new InsertSubtreeCommand(m_family.get(), parentId, members));
+}
+
+void MainWindow::onDeleteBranch() {
+  MemberId id = m_scene->selectedMemberId();
+  if (!m_family->members().count(id) || id == m_family->rootId()) {
+    return;
+  }
+  m_undoStack->push(new RemoveSubtreeCommand(m_family.get(), id));
+}
+
+void MainWindow::onRebuildProgress(int built, int total) {
+  if (built >= total) {
+    ui->statusbar->clearMessage();
+    return;
+  }
+  ui->statusbar->showMessage(tr("Building %1/%2").arg(built).arg(total));
+}
+
+void MainWindow::onSearch() {
+  Q_ASSERT(m_family);
+  QString text = m_searchEdit->text().trimmed();
+  if (text != m_lastSearchText) {
+    m_lastSearchText = text;
+    m_searchResults = m_family->search(text);
+    m_isSearchTruncated = m_searchResults.size() >= FamilySearchIndex::kDefaultLimit;
+    std::unordered_set<MemberId, MemberIdHash> found(m_searchResults.begin(), m_searchResults.end());
+    std::vector<FamilyPinyinIndex::Result> pinyinResults = m_family->searchPinyin(text);
+    m_isSearchTruncated |= pinyinResults.size() >= FamilyPinyinIndex::kDefaultLimit;
+    for (const FamilyPinyinIndex::Result& result : pinyinResults) {
+      if (found.insert(result.id).second) {
+        m_searchResults.push_back(result.id);
+      }
+    }
+    m_searchResultIndex = 0;
+  } else if (!m_searchResults.empty()) {
+    m_searchResultIndex = (m_searchResultIndex + 1) % m_searchResults.size();
+  }
+  if (m_searchResults.empty()) {
+    ui->statusbar->showMessage(tr("No match"), 3000);
+    return;
+  }
+  FamilyMemberItem* item = m_scene->selectMember(m_searchResults[m_searchResultIndex]);
+  if (item == nullptr) {
+    return;
+  }
+  ui->graphicsView->centerOn(item);
+  QString message = tr("%1/%2").arg(m_searchResultIndex + 1).arg(m_searchResults.size());
+  if (m_isSearchTruncated) {
+    message += tr(" (showing the first %1 matches)").arg(FamilySearchIndex::kDefaultLimit);
+  }
+  ui->statusbar->showMessage(message, 3000);
+}
+
+void MainWindow::onSelectionChanged() {
+  std::vector<MemberId> ids = m_scene->selectedMemberIds();
+  if (ids.size() == 1) {
+    m_kinshipAnchorId = ids[0];
+    SubTreeStats stats = m_family->subTreeStats(ids[0]);
+    ui->statusbar->showMessage(tr("Descendants: %1  Living: %2  Male: %3  Female: %4  Generations: %5")
+                                   .arg(stats.memberCount - 1)
+                                   .arg(stats.livingCount)
+                                   .arg(stats.maleCount)
+                                   .arg(stats.femaleCount)
+                                   .arg(stats.depth));
+    return;
+  }
+  if (ids.size() != 2 || (ids[0] != m_kinshipAnchorId && ids[1] != m_kinshipAnchorId)) {
+    return;
+  }
+  MemberId otherId = ids[0] == m_kinshipAnchorId ? ids[1] : ids[0];
+  QString term = m_family->kinshipTerm(m_kinshipAnchorId, otherId);
+  if (term == "") {
+    return;
+  }
+  ui->statusbar->showMessage(
+      QString("%1是%2的%3").arg(m_family->getMember(otherId).name, m_family->getMember(m_kinshipAnchorId).name, term));
+}
+
+void MainWindow::offerRecovery() {
+  if (m_autosave->adoptOrphan()) {
+    QMessageBox::StandardButton button =
+        QMessageBox::question(this, tr("Recover"), tr("FamilyTree did not exit normally. Recover unsaved changes?"),
+                              QMessageBox::Yes | QMessageBox::No, QMessageBox::Yes);
+    QString sourcePath;
+    Family* family = button == QMessageBox::Yes ? m_autosave->restore(&sourcePath) : nullptr;
+    if (family && family->isValid()) {
+      doLoad(sourcePath, family);
+      m_autosave->continueRecovered();
+    } else {
+      if (button == QMessageBox::Yes) {
+        qDebug() << "can't recover";
+        delete family;
+      }
+      m_autosave->discard();
+    }
+  }
+  m_autosave->start();
 }
 
 void MainWindow::doLoad(const QString& path, Family* family) {
@@ -151,10 +515,16 @@ void MainWindow::doLoad(const QString& path, Family* family) {
 
   qDebug() << "family size:" << family->size();
 
+  m_undoStack->clear();
+  m_cutId = MemberId();
   m_scene->setFamily(family);
   m_family.reset(family);
+  m_autosave->setFamily(family, path);
   setCurrentFilePath(path);
   connect(m_family.get(), &Family::isDirtyChanged, this, &MainWindow::updateWindowTitle);
+  connect(m_family.get(), &Family::memberUpdated, this, [this]() { m_lastSearchText.clear(); });
+  connect(m_family.get(), &Family::relayouted, this, [this]() { m_lastSearchText.clear(); });
+  m_lastSearchText.clear();
   updateWindowTitle();
 }
 
@@ -164,20 +534,16 @@ void MainWindow::doSave(const QString& path, Family* family) {
   Q_ASSERT(family->isValid());
   Q_ASSERT(path != "");
 
-  QFile file(path);
-  bool ret = file.open(QFile::WriteOnly | QFile::Truncate);
+  m_autosave->waitForWrite();
+  bool ret = family->save(path);
   Q_ASSERT(ret);
   if (!ret) {
     return;
   }
-  QString json = m_family->toJson();
-  file.write(json.toUtf8());
-  file.close();
-
-  qDebug().noquote() << json;
 
   setCurrentFilePath(path);
   family->setIsDirty(false);
+  m_autosave->setFamily(family, path);
 }
 
 QMessageBox::StandardButton MainWindow::promptSave() {
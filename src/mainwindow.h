@@ -25,10 +25,13 @@
 #pragma once
 
 #include <QGraphicsScene>
+#include <QLineEdit>
 #include <QMainWindow>
 #include <QMessageBox>
+#include <QUndoStack>
 
 #include "family.h"
+#include "familyautosave.h"
 #include "familymembereditdialog.h"
 #include "familytreescene.h"
 
@@ -58,12 +61,26 @@ class MainWindow : public QMainWindow {
   void onLoad(bool bypassPromptSave = false);
   void onSave();
   void onExport();
+  void onExportGeneration();
+  void onMerge();
+  void onGoToGeneration();
+  void onMemoryReport();
+  void offerRecovery();
 
   void onAddChild();
   void onEdit();
+  void onCut();
+  void onCopy();
+  void onPaste();
+  void onDeleteBranch();
+  void onRebuildProgress(int built, int total);
+  void onSearch();
+  void onSelectionChanged();
 
   void doLoad(const QString& path, Family* family);
   void doSave(const QString& path, Family* family);
+  void exportImage(const QString& path, const QRectF& sourceRect);
+  int askGeneration(const QString& title);
 
   QMessageBox::StandardButton promptSave();
   void updateWindowTitle();
@@ -73,9 +90,28 @@ class MainWindow : public QMainWindow {
   FamilyMemberEditDialog* m_memberEditDialog = nullptr;
   QMenu* m_itemMenu = nullptr;
   QAction* m_addChildAction = nullptr;
+  QAction* m_cutAction = nullptr;
+  QAction* m_copyAction = nullptr;
+  QAction* m_pasteAction = nullptr;
+  QAction* m_deleteBranchAction = nullptr;
+  QUndoStack* m_undoStack = nullptr;
+
+  // A copied branch with its original ids, remapped on every paste. A cut branch is only marked and moved on paste.
+  std::vector<FamilyMember> m_clipboard;
+  MemberId m_cutId;
+  QLineEdit* m_searchEdit = nullptr;
+
+  QString m_lastSearchText;
+  std::vector<MemberId> m_searchResults;
+  size_t m_searchResultIndex = 0;
+  // The indexes stopped at their result cap, there may be more matches than listed.
+  bool m_isSearchTruncated = false;
+
+  MemberId m_kinshipAnchorId;
 
   FamilyTreeScene* m_scene = nullptr;
   std::unique_ptr<Family> m_family = nullptr;
+  FamilyAutosave* m_autosave = nullptr;
 
   QString m_currentFilePath;
 };
@@ -0,0 +1,81 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "memoryreport.h"
+
+#include <QStringList>
+
+#include "family.h"
+#include "familytreescene.h"
+#include "perfstats.h"
+#include "portraitcache.h"
+
+// QArrayData header in front of every string buffer.
+static constexpr qint64 kArrayHeaderSize = 3 * sizeof(void*);
+
+MemoryReport MemoryReport::collect(const Family* family, const FamilyTreeScene* scene) {
+  MemoryReport result;
+  if (family) {
+    family->reportMemory(result);
+  }
+  if (scene) {
+    scene->reportMemory(result);
+  }
+  const PortraitCache& cache = PortraitCache::instance();
+  result.add("Portrait cache", cache.size(), cache.cost());
+  return result;
+}
+
+void MemoryReport::add(const QString& name, qint64 count, qint64 bytes) { entries.push_back({name, count, bytes}); }
+
+qint64 MemoryReport::totalBytes() const {
+  qint64 result = 0;
+  for (const Entry& entry : entries) {
+    result += entry.bytes;
+  }
+  return result;
+}
+
+QString MemoryReport::toText() const {
+  auto row = [](const QString& name, const QString& count, qint64 bytes) {
+    QString size = bytes < 0 ? QString("n/a") : QString("%1 KB").arg(bytes >> 10);
+    return QString("%1%2%3").arg(name, -24).arg(count, 10).arg(size, 14);
+  };
+  QStringList lines;
+  for (const Entry& entry : entries) {
+    lines << row(entry.name, QString::number(entry.count), entry.bytes);
+  }
+  lines << row("Total", "", totalBytes());
+  // The export image is freed once written, so it is a peak rather than part of what is held now.
+  lines << row("Last export (peak)", "", exportImageBytes);
+  lines << row("Resident (process)", "", PerfStats::residentMemory());
+  return lines.join('\n');
+}
+
+qint64 MemoryReport::stringBytes(const QString& s) {
+  if (s.isEmpty()) {
+    return 0;
+  }
+  return kArrayHeaderSize + (s.capacity() + 1) * sizeof(QChar);
+}
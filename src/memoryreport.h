@@ -0,0 +1,63 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <atomic>
+#include <vector>
+
+class Family;
+class FamilyTreeScene;
+
+// Estimated heap use per subsystem, filled in by Family::reportMemory and FamilyTreeScene::reportMemory. Sizes follow
+// the usual container layouts rather than the allocator, they are meant for comparing builds, not for exact totals.
+struct MemoryReport {
+  struct Entry {
+    QString name;
+    qint64 count = 0;
+    qint64 bytes = 0;
+  };
+  std::vector<Entry> entries;
+
+  // Everything the app holds for this family and scene, either may be null.
+  static MemoryReport collect(const Family* family, const FamilyTreeScene* scene);
+
+  void add(const QString& name, qint64 count, qint64 bytes);
+  qint64 totalBytes() const;
+  QString toText() const;
+
+  // Buffer of a QString, 0 for the shared empty one.
+  static qint64 stringBytes(const QString& s);
+  // Color, parent and child links of a std::map node, and the next link and cached hash of an unordered one.
+  static constexpr qint64 kTreeNodeOverhead = 4 * sizeof(void*);
+  static constexpr qint64 kHashNodeOverhead = 2 * sizeof(void*);
+  // Rough sizes of the private objects behind a QGraphicsItem and behind a QTextDocument with its layout.
+  static constexpr qint64 kGraphicsItemPrivateSize = 320;
+  static constexpr qint64 kTextDocumentPrivateSize = 2048;
+
+  // Pixel buffer of the last export, the largest single allocation the app makes. It only lives while exporting, so it
+  // is reported apart from the total.
+  static inline std::atomic<qint64> exportImageBytes{0};
+};
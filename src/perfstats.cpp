@@ -0,0 +1,68 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "perfstats.h"
+
+#if defined(Q_OS_LINUX)
+#include <QFile>
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+// clang-format off
+#include <windows.h>
+#include <psapi.h>
+// clang-format on
+#elif defined(Q_OS_MACOS)
+#include <mach/mach.h>
+#endif
+
+qint64 PerfStats::residentMemory() {
+#if defined(Q_OS_LINUX)
+  QFile file("/proc/self/statm");
+  if (!file.open(QFile::ReadOnly)) {
+    return -1;
+  }
+  QList<QByteArray> fields = file.readAll().split(' ');
+  if (fields.size() < 2) {
+    return -1;
+  }
+  return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#elif defined(Q_OS_WIN)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return -1;
+  }
+  return counters.WorkingSetSize;
+#elif defined(Q_OS_MACOS)
+  mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  kern_return_t error =
+      task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count);
+  if (error != KERN_SUCCESS) {
+    return -1;
+  }
+  return info.resident_size;
+#else
+  return -1;
+#endif
+}
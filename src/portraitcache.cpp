@@ -0,0 +1,152 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "portraitcache.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QImageReader>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+
+#include "trace.h"
+
+static constexpr qint64 kDefaultCapacity = 64 << 20;
+// Requests older than this are dropped before decoding, they were for cards that have long been panned away.
+static constexpr quint64 kMaxQueuedRequests = 256;
+static constexpr int kMinZoomBucket = -2;
+static constexpr int kMaxZoomBucket = 2;
+static constexpr int kReadyIntervalMs = 16;
+
+PortraitCache& PortraitCache::instance() {
+  static PortraitCache* cache = new PortraitCache(QCoreApplication::instance());
+  return *cache;
+}
+
+PortraitCache::PortraitCache(QObject* parent) : QObject(parent), m_capacity(kDefaultCapacity) {
+  m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+  m_readyTimer.setSingleShot(true);
+  m_readyTimer.setInterval(kReadyIntervalMs);
+  connect(&m_readyTimer, &QTimer::timeout, this, &PortraitCache::portraitsReady);
+}
+
+PortraitCache::~PortraitCache() {
+  m_pool.clear();
+  m_pool.waitForDone();
+}
+
+QPixmap PortraitCache::get(const QString& path, const QSize& baseSize, int bucket) {
+  QString key = QString("%1@%2").arg(path).arg(bucket);
+  auto iter = m_keyToEntry.find(key);
+  if (iter != m_keyToEntry.end()) {
+    m_entries.splice(m_entries.begin(), m_entries, iter->second);
+    return iter->second->pixmap;
+  }
+
+  QSize size = baseSize * std::pow(2.0, bucket);
+  if (m_isBlocking) {
+    insert(key, decode(path, size));
+    return m_entries.front().pixmap;
+  }
+  if (!m_pending.insert(key).second) {
+    return QPixmap();
+  }
+  quint64 serial = ++m_requestSerial;
+  m_pool.start([this, key, path, size, serial]() {
+    bool isStale = m_requestSerial - serial >= kMaxQueuedRequests;
+    QImage image = isStale ? QImage() : decode(path, size);
+    QMetaObject::invokeMethod(
+        this,
+        [this, key, image, isStale]() {
+          m_pending.erase(key);
+          if (isStale) {
+            return;
+          }
+          insert(key, image);
+          if (!m_readyTimer.isActive()) {
+            m_readyTimer.start();
+          }
+        },
+        Qt::QueuedConnection);
+  });
+  return QPixmap();
+}
+
+int PortraitCache::zoomBucket(qreal levelOfDetail) {
+  if (levelOfDetail <= 0) {
+    return kMinZoomBucket;
+  }
+  return std::clamp(static_cast<int>(std::ceil(std::log2(levelOfDetail))), kMinZoomBucket, kMaxZoomBucket);
+}
+
+void PortraitCache::setCapacity(qint64 bytes) {
+  m_capacity = bytes;
+  evict();
+}
+
+QImage PortraitCache::decode(const QString& path, const QSize& size) {
+  TRACE_SCOPE("PortraitCache::decode");
+  QImageReader reader(path);
+  reader.setAutoTransform(true);
+  // Lets the jpeg decoder skip detail instead of decoding the full image and scaling it afterwards.
+  QSize imageSize = reader.size();
+  if (imageSize.isValid()) {
+    reader.setScaledSize(imageSize.scaled(size, Qt::KeepAspectRatioByExpanding));
+  }
+  QImage result = reader.read();
+  if (result.isNull()) {
+    qDebug() << "can't read portrait" << path << reader.errorString();
+  }
+  return result;
+}
+
+// A failed decode is cached as a null pixmap as well, so a missing file isn't retried on every paint.
+void PortraitCache::insert(const QString& key, const QImage& image) {
+  // A blocking decode may have filled the key while an async one was pending, the newer image replaces it.
+  auto iter = m_keyToEntry.find(key);
+  if (iter != m_keyToEntry.end()) {
+    m_cost -= iter->second->cost;
+    m_entries.erase(iter->second);
+    m_keyToEntry.erase(iter);
+  }
+  Entry entry;
+  entry.key = key;
+  entry.pixmap = QPixmap::fromImage(image);
+  entry.cost = static_cast<qint64>(image.sizeInBytes()) + key.size() * sizeof(QChar);
+  m_entries.push_front(entry);
+  m_keyToEntry[key] = m_entries.begin();
+  m_cost += entry.cost;
+  evict();
+}
+
+void PortraitCache::evict() {
+  // The newest entry stays even if it alone exceeds the capacity, it is about to be drawn.
+  while (m_cost > m_capacity && m_entries.size() > 1) {
+    const Entry& entry = m_entries.back();
+    m_cost -= entry.cost;
+    m_keyToEntry.erase(entry.key);
+    m_entries.pop_back();
+  }
+}
@@ -0,0 +1,86 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QObject>
+#include <QPixmap>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+// Thumbnails of member portraits. Images are decoded and downscaled on a thread pool, the results are kept in an LRU
+// cache bounded by pixel memory, keyed by path and zoom bucket so a card drawn at a similar scale reuses them.
+class PortraitCache : public QObject {
+  Q_OBJECT
+
+ public:
+  static PortraitCache& instance();
+  ~PortraitCache();
+
+  // Returns the thumbnail for a box of baseSize at the given zoom bucket, or a null pixmap while it is being decoded
+  // or when it can't be read.
+  QPixmap get(const QString& path, const QSize& baseSize, int bucket);
+  static int zoomBucket(qreal levelOfDetail);
+
+  qint64 capacity() const { return m_capacity; }
+  void setCapacity(qint64 bytes);
+  qint64 cost() const { return m_cost; }
+  int size() const { return m_entries.size(); }
+
+  // Decode on the calling thread, for offscreen rendering that can't wait for the pool.
+  void setBlocking(bool blocking) { m_isBlocking = blocking; }
+
+ signals:
+  // Batched, emitted at most once per frame.
+  void portraitsReady();
+
+ private:
+  PortraitCache(QObject* parent);
+
+  static QImage decode(const QString& path, const QSize& size);
+  void insert(const QString& key, const QImage& image);
+  void evict();
+
+ private:
+  struct Entry {
+    QString key;
+    QPixmap pixmap;
+    qint64 cost = 0;
+  };
+  // Most recently used first.
+  std::list<Entry> m_entries;
+  std::unordered_map<QString, std::list<Entry>::iterator> m_keyToEntry;
+  std::unordered_set<QString> m_pending;
+  qint64 m_capacity = 0;
+  qint64 m_cost = 0;
+  bool m_isBlocking = false;
+
+  QThreadPool m_pool;
+  std::atomic<quint64> m_requestSerial{0};
+  QTimer m_readyTimer;
+};
@@ -0,0 +1,125 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+static constexpr size_t kRingSize = 1 << 16;
+
+struct TraceEvent {
+  const char* name = nullptr;
+  qint64 begin = 0;
+  qint64 end = 0;
+};
+
+// Written only by its own thread, the dump reads up to the published count.
+struct TraceBuffer {
+  int tid = 0;
+  std::atomic<quint64> count{0};
+  std::array<TraceEvent, kRingSize> events;
+};
+
+static std::mutex s_buffersMutex;
+static std::vector<std::shared_ptr<TraceBuffer>> s_buffers;
+
+// The lock is only taken once per thread, the registry keeps the buffer alive after its thread exits.
+static TraceBuffer& threadBuffer() {
+  thread_local std::shared_ptr<TraceBuffer> buffer = []() {
+    auto result = std::make_shared<TraceBuffer>();
+    std::lock_guard<std::mutex> lock(s_buffersMutex);
+    result->tid = s_buffers.size() + 1;
+    s_buffers.push_back(result);
+    return result;
+  }();
+  return *buffer;
+}
+
+qint64 Trace::now() {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Trace::record(const char* name, qint64 begin, qint64 end) {
+  TraceBuffer& buffer = threadBuffer();
+  quint64 count = buffer.count.load(std::memory_order_relaxed);
+  buffer.events[count % kRingSize] = {name, begin, end};
+  buffer.count.store(count + 1, std::memory_order_release);
+}
+
+// Names are usually literals, but nothing stops one from holding a quote or a backslash.
+static QByteArray jsonEscaped(const char* s) {
+  QByteArray result;
+  for (; *s; s++) {
+    char c = *s;
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      result += "\\u00" + QByteArray::number(static_cast<unsigned char>(c), 16).rightJustified(2, '0');
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+bool Trace::dump(const QString& path) {
+  QFile file(path);
+  if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+    qDebug() << "can't open" << path;
+    return false;
+  }
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(s_buffersMutex);
+    buffers = s_buffers;
+  }
+  qint64 pid = QCoreApplication::applicationPid();
+  bool isFirst = true;
+  file.write("{\"traceEvents\":[\n");
+  for (const std::shared_ptr<TraceBuffer>& buffer : buffers) {
+    quint64 count = buffer->count.load(std::memory_order_acquire);
+    quint64 first = count > kRingSize ? count - kRingSize : 0;
+    for (quint64 i = first; i < count; i++) {
+      const TraceEvent& event = buffer->events[i % kRingSize];
+      QByteArray line = isFirst ? "" : ",\n";
+      line += "{\"name\":\"" + jsonEscaped(event.name) + "\",\"ph\":\"X\"";
+      line += ",\"ts\":" + QByteArray::number(event.begin / 1000.0, 'f', 3);
+      line += ",\"dur\":" + QByteArray::number((event.end - event.begin) / 1000.0, 'f', 3);
+      line += ",\"pid\":" + QByteArray::number(pid) + ",\"tid\":" + QByteArray::number(buffer->tid) + "}";
+      file.write(line);
+      isFirst = false;
+    }
+  }
+  file.write("\n]}\n");
+  return true;
+}
@@ -0,0 +1,67 @@
+/*********************************************************************************
+ * MIT License
+ *
+ * Copyright (c) 2024 Jia Lihong
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ ********************************************************************************/
+
+#pragma once
+
+#include <QString>
+#include <atomic>
+
+// Scoped trace spans written as a Chrome trace (chrome://tracing, ui.perfetto.dev). Each thread records into its own
+// ring buffer without locking, a disabled span costs one relaxed atomic load.
+class Trace {
+ public:
+  static bool isEnabled() { return s_isEnabled.load(std::memory_order_relaxed); }
+  static void setEnabled(bool enabled) { s_isEnabled.store(enabled, std::memory_order_relaxed); }
+
+  // Nanoseconds since the first call.
+  static qint64 now();
+  // name must outlive the trace, e.g. a string literal.
+  static void record(const char* name, qint64 begin, qint64 end);
+  // Best taken while no spans are being recorded, a span written during the dump may come out torn.
+  static bool dump(const QString& path);
+
+ private:
+  static inline std::atomic<bool> s_isEnabled{false};
+};
+
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name)
+      : m_name(Trace::isEnabled() ? name : nullptr), m_begin(m_name ? Trace::now() : 0) {}
+  ~TraceScope() {
+    if (m_name) {
+      Trace::record(m_name, m_begin, Trace::now());
+    }
+  }
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* m_name = nullptr;
+  qint64 m_begin = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)